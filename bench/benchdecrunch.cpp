@@ -0,0 +1,8 @@
+﻿// benchdecrunch.cpp - generated decrunch for the benchmark, in its own translation unit
+//
+// (c) 2025 Ossi Luoto
+//
+// bench_decrunch.h is written at build time with spirvcruncher --decoder-only all
+
+#include <stddef.h>
+#include "bench_decrunch.h"
@@ -0,0 +1,9 @@
+﻿// benchdecrunchgroup.cpp - generated decrunch with group varints for the benchmark
+//
+// (c) 2025 Ossi Luoto
+//
+// bench_decrunch_group.h is written at build time with spirvcruncher --decoder-only all.og
+
+#include <stddef.h>
+#define decrunch decrunch_groupvarint
+#include "bench_decrunch_group.h"
@@ -0,0 +1,59 @@
+# round trip of a corpus through spirvcruncher and the generated decrunch
+#
+# Runs spirvcruncher with OPTIONS on the modules of CORPUS, with --spirv-out for the modules after
+# the passes, then compiles the header with roundtripcheck.cpp, which runs DECRUNCH_ALL_SHADERS,
+# compares each shader with its --spirv-out module and checks the module against its input. With
+# SPIRV_VAL set the --spirv-out modules also go through spirv-val.
+#
+# Variables: SPIRVCRUNCHER, CORPUS, WORK, OPTIONS (space separated), CXX, CXX_ID, SOURCE_DIR, SPIRV_VAL
+separate_arguments(OPTION_LIST UNIX_COMMAND "${OPTIONS}")
+
+file(REMOVE_RECURSE "${WORK}")
+file(MAKE_DIRECTORY "${WORK}")
+
+execute_process(
+    COMMAND "${SPIRVCRUNCHER}" -i "${CORPUS}/*.spv" -o "${WORK}/roundtrip_shaders.h" --spirv-out "${WORK}/spirv" --silent ${OPTION_LIST}
+    RESULT_VARIABLE RESULT
+)
+if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "spirvcruncher ${OPTIONS} failed: ${RESULT}")
+endif()
+
+# A ROUNDTRIP_SHADER line for each module, names are the array names of the header
+file(GLOB MODULES "${WORK}/spirv/*.spv")
+if(NOT MODULES)
+    message(FATAL_ERROR "spirvcruncher ${OPTIONS} wrote no modules to ${WORK}/spirv")
+endif()
+set(SHADER_LIST "")
+foreach(MODULE ${MODULES})
+    get_filename_component(NAME "${MODULE}" NAME_WE)
+    string(APPEND SHADER_LIST "ROUNDTRIP_SHADER(${NAME})\n")
+endforeach()
+file(WRITE "${WORK}/roundtrip_shaders.inc" "${SHADER_LIST}")
+
+if(SPIRV_VAL)
+    foreach(MODULE ${MODULES})
+        execute_process(COMMAND "${SPIRV_VAL}" "${MODULE}" RESULT_VARIABLE RESULT)
+        if(NOT RESULT EQUAL 0)
+            message(FATAL_ERROR "spirv-val fails on ${MODULE} of spirvcruncher ${OPTIONS}")
+        endif()
+    endforeach()
+endif()
+
+if(CXX_ID STREQUAL "MSVC")
+    set(COMPILE_COMMAND "${CXX}" /nologo /std:c++20 /EHsc /O1 "/I${WORK}" "${SOURCE_DIR}/bench/roundtripcheck.cpp" "/Fe${WORK}/roundtripcheck.exe" "/Fo${WORK}/")
+    set(CHECK "${WORK}/roundtripcheck.exe")
+else()
+    set(COMPILE_COMMAND "${CXX}" -std=c++20 -O1 "-I${WORK}" "${SOURCE_DIR}/bench/roundtripcheck.cpp" -o "${WORK}/roundtripcheck")
+    set(CHECK "${WORK}/roundtripcheck")
+endif()
+
+execute_process(COMMAND ${COMPILE_COMMAND} RESULT_VARIABLE RESULT)
+if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "Header of spirvcruncher ${OPTIONS} doesn't compile")
+endif()
+
+execute_process(COMMAND "${CHECK}" "${WORK}/spirv" "${CORPUS}" RESULT_VARIABLE RESULT)
+if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "Decrunch output of spirvcruncher ${OPTIONS} differs from the --spirv-out modules, or they lost the interface of the input")
+endif()
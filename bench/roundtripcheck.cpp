@@ -0,0 +1,189 @@
+﻿// roundtripcheck.cpp - decrunch output of a generated header against the --spirv-out modules
+//
+// (c) 2025 Ossi Luoto
+//
+// Compiled by roundtrip.cmake with roundtrip_shaders.h, the header of the test, and
+// roundtrip_shaders.inc, a ROUNDTRIP_SHADER(name) line for each shader of it.
+//
+// With the input directory the --spirv-out modules are also checked against the inputs: the passes
+// must keep the WorkgroupSize and SpecId decorations, and the constants and variables they decorate.
+//
+// Usage: roundtripcheck <spirv-out dir> [<input dir>]
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+
+#include "roundtrip_shaders.h"
+
+using namespace std;
+
+enum
+{
+	kOpConstantTrue = 41,
+	kOpConstantComposite = 44,
+	kOpSpecConstantComposite = 51,
+	kOpSpecConstantOp = 52,
+	kOpVariable = 59,
+	kOpDecorate = 71,
+};
+
+enum
+{
+	kDecorationSpecId = 1,
+	kDecorationBuiltIn = 11,
+};
+
+struct ModuleInstruction
+{
+	uint32_t op;
+	size_t offset;
+	uint32_t length;
+};
+
+struct Module
+{
+	vector<uint32_t> words;
+	vector<ModuleInstruction> instructions;
+};
+
+// Module words and instructions, false if the header or an instruction length is broken
+static bool readModule(const string& path, Module& module)
+{
+	ifstream file(path, ios::binary);
+	vector<char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	module.words.resize(bytes.size() / 4);
+	memcpy(module.words.data(), bytes.data(), module.words.size() * 4);
+	if (module.words.size() < 5 || module.words[0] != 0x07230203) return false;
+
+	for (size_t offset = 5; offset < module.words.size();)
+	{
+		const uint32_t length = module.words[offset] >> 16;
+		if (length == 0 || offset + length > module.words.size()) return false;
+		module.instructions.push_back({ module.words[offset] & 0xffff, offset, length });
+		offset += length;
+	}
+	return true;
+}
+
+// Constant or variable with the result id, the decoration targets of the check
+static const ModuleInstruction* findDefinition(const Module& module, uint32_t id)
+{
+	for (const auto& instruction : module.instructions)
+	{
+		const bool bDefines = (instruction.op >= kOpConstantTrue && instruction.op <= kOpSpecConstantOp) || instruction.op == kOpVariable;
+		if (bDefines && instruction.length > 2 && module.words[instruction.offset + 2] == id) return &instruction;
+	}
+	return nullptr;
+}
+
+// Decoration with the same decoration and literals, IDs differ after --renumber
+static const ModuleInstruction* findDecoration(const Module& module, const uint32_t* decoration, uint32_t length)
+{
+	for (const auto& instruction : module.instructions)
+	{
+		if (instruction.op != kOpDecorate || instruction.length != length) continue;
+		if (equal(decoration + 2, decoration + length, module.words.data() + instruction.offset + 2)) return &instruction;
+	}
+	return nullptr;
+}
+
+static bool checkInterface(const char* name, const string& spirvDir, const string& inputDir)
+{
+	Module input, output;
+	if (!readModule(inputDir + "/" + name + ".spv", input) || !readModule(spirvDir + "/" + name + ".spv", output))
+	{
+		cerr << name << ": not a valid module" << endl;
+		return false;
+	}
+
+	for (const auto& instruction : input.instructions)
+	{
+		const uint32_t* decoration = input.words.data() + instruction.offset;
+		if (instruction.op != kOpDecorate || instruction.length < 4) continue;
+		if (decoration[2] != kDecorationSpecId && decoration[2] != kDecorationBuiltIn) continue;
+
+		const ModuleInstruction* inputTarget = findDefinition(input, decoration[1]);
+		if (!inputTarget) continue;
+
+		const char* kind = decoration[2] == kDecorationSpecId ? "SpecId " : "BuiltIn ";
+		const ModuleInstruction* kept = findDecoration(output, decoration, instruction.length);
+		if (!kept)
+		{
+			cerr << name << ": " << kind << decoration[3] << " decoration removed" << endl;
+			return false;
+		}
+
+		const uint32_t target = output.words[kept->offset + 1];
+		const ModuleInstruction* outputTarget = target < output.words[3] ? findDefinition(output, target) : nullptr;
+		if (!outputTarget || outputTarget->op != inputTarget->op || outputTarget->length != inputTarget->length)
+		{
+			cerr << name << ": target of " << kind << decoration[3] << " removed or changed" << endl;
+			return false;
+		}
+
+		// Constituents of the WorkgroupSize composite
+		if (outputTarget->op != kOpConstantComposite && outputTarget->op != kOpSpecConstantComposite) continue;
+		for (uint32_t w = 3; w < outputTarget->length; ++w)
+		{
+			if (!findDefinition(output, output.words[outputTarget->offset + w]))
+			{
+				cerr << name << ": constituent of " << kind << decoration[3] << " removed" << endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Decrunch doesn't write generator and schema words, they stay 0 in the shader buffers
+static bool checkShader(const char* name, const uint32_t* decoded, size_t sizeInBytes, const string& spirvDir)
+{
+	ifstream file(spirvDir + "/" + name + ".spv", ios::binary);
+	vector<char> spirv((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	if (spirv.size() != sizeInBytes)
+	{
+		cerr << name << ": " << sizeInBytes << " bytes decoded, module has " << spirv.size() << endl;
+		return false;
+	}
+
+	for (size_t i = 0; i < sizeInBytes / 4; ++i)
+	{
+		uint32_t word;
+		memcpy(&word, spirv.data() + i * 4, 4);
+		if (i == 2 || i == 4) word = 0;
+		if (decoded[i] != word)
+		{
+			cerr << name << ": differs at word " << i << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		cerr << "Usage: " << argv[0] << " <spirv-out dir> [<input dir>]" << endl;
+		return 1;
+	}
+
+	DECRUNCH_ALL_SHADERS();
+
+	int shaders = 0;
+	int failures = 0;
+#define ROUNDTRIP_SHADER(name) shaders++; failures += checkShader(#name, name##_buffer, name##_sizeInBytes, argv[1]) && \
+	(argc < 3 || checkInterface(#name, argv[1], argv[2])) ? 0 : 1;
+#include "roundtrip_shaders.inc"
+#undef ROUNDTRIP_SHADER
+
+	cout << shaders - failures << " of " << shaders << " shaders round trip" << endl;
+	return failures ? 1 : 0;
+}
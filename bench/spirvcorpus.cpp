@@ -0,0 +1,520 @@
+﻿// spirvcorpus.cpp - synthetic SPIR-V corpus generator for scale testing
+//
+// (c) 2025 Ossi Luoto
+//
+// Writes fragment shader modules shaped like typical compiler output: uniform block, inputs, outputs,
+// function locals and a body of arithmetic, shuffles, composites, GLSL.std.450 calls and memory ops.
+// With --compute a share of them are compute shaders, which read the uniform block, write a private
+// variable and have a WorkgroupSize spec constant composite and an unused SpecId constant.
+// Same seed and options give the same corpus on every platform.
+//
+// Usage: spirvcruncher_corpus [--count <n>] [--out <dir>] [--seed <n>] [--instructions <n>]
+//        [--mix arith=4,shuffle=2,composite=1,extinst=1,memory=1,dot=1,uniform=1]
+//        [--decorations <0..1>] [--debug <0..1>] [--duplicates <0..1>] [--compute <0..1>]
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <filesystem>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+enum
+{
+	kOpSource = 3,
+	kOpName = 5,
+	kOpMemberName = 6,
+	kOpString = 7,
+	kOpLine = 8,
+	kOpExtInstImport = 11,
+	kOpExtInst = 12,
+	kOpMemoryModel = 14,
+	kOpEntryPoint = 15,
+	kOpExecutionMode = 16,
+	kOpCapability = 17,
+	kOpTypeVoid = 19,
+	kOpTypeInt = 21,
+	kOpTypeFloat = 22,
+	kOpTypeVector = 23,
+	kOpTypeStruct = 30,
+	kOpTypePointer = 32,
+	kOpTypeFunction = 33,
+	kOpConstant = 43,
+	kOpSpecConstant = 50,
+	kOpSpecConstantComposite = 51,
+	kOpFunction = 54,
+	kOpFunctionEnd = 56,
+	kOpVariable = 59,
+	kOpLoad = 61,
+	kOpStore = 62,
+	kOpAccessChain = 65,
+	kOpDecorate = 71,
+	kOpMemberDecorate = 72,
+	kOpVectorShuffle = 79,
+	kOpCompositeConstruct = 80,
+	kOpCompositeExtract = 81,
+	kOpFNegate = 127,
+	kOpFAdd = 129,
+	kOpFSub = 131,
+	kOpFMul = 133,
+	kOpFDiv = 136,
+	kOpVectorTimesScalar = 142,
+	kOpDot = 148,
+	kOpLabel = 248,
+	kOpReturn = 253,
+};
+
+enum
+{
+	kDecorationRelaxedPrecision = 0,
+	kDecorationSpecId = 1,
+	kDecorationBlock = 2,
+	kDecorationBuiltIn = 11,
+	kDecorationLocation = 30,
+	kDecorationBinding = 33,
+	kDecorationDescriptorSet = 34,
+	kDecorationOffset = 35,
+};
+
+enum
+{
+	kStorageInput = 1,
+	kStorageUniform = 2,
+	kStorageOutput = 3,
+	kStoragePrivate = 6,
+	kStorageFunction = 7,
+};
+
+enum
+{
+	kExecutionModelFragment = 4,
+	kExecutionModelGLCompute = 5,
+	kExecutionModeOriginUpperLeft = 7,
+	kExecutionModeLocalSize = 17,
+	kBuiltInWorkgroupSize = 25,
+};
+
+enum OpClass { kArith, kShuffle, kComposite, kExtInst, kMemory, kDot, kUniform, kOpClassCount };
+static const char* kOpClassNames[kOpClassCount] = { "arith", "shuffle", "composite", "extinst", "memory", "dot", "uniform" };
+
+struct CorpusOptions {
+	size_t count = 10;
+	string outDir = "corpus";
+	uint32_t seed = 1;
+	size_t instructions = 200;			// mean body instructions per shader
+	double mix[kOpClassCount] = { 4, 2, 1, 1, 1, 1, 1 };
+	double decorations = 0.1;			// RelaxedPrecision per arithmetic result
+	double debug = 0.5;					// share of shaders with debug info
+	double duplicates = 0.05;			// share of shaders that repeat an earlier one
+	double compute = 0.0;				// share of compute shaders
+};
+
+// Own distributions, std ones differ between standard libraries
+struct CorpusRandom {
+	mt19937 engine;
+
+	explicit CorpusRandom(uint32_t seed) : engine(seed) {}
+	uint32_t below(uint32_t n) { return n ? engine() % n : 0; }
+	double unit() { return (double)engine() / 4294967296.0; }
+	bool chance(double p) { return unit() < p; }
+};
+
+static void emit(vector<uint32_t>& section, uint32_t op, const vector<uint32_t>& operands)
+{
+	section.push_back(((uint32_t)(operands.size() + 1) << 16) | op);
+	section.insert(section.end(), operands.begin(), operands.end());
+}
+
+static vector<uint32_t> stringWords(const string& text)
+{
+	vector<uint32_t> words((text.size() + 4) / 4, 0);
+	for (size_t i = 0; i < text.size(); ++i) words[i / 4] |= (uint32_t)(uint8_t)text[i] << ((i % 4) * 8);
+	return words;
+}
+
+static vector<uint32_t> concat(vector<uint32_t> a, const vector<uint32_t>& b)
+{
+	a.insert(a.end(), b.begin(), b.end());
+	return a;
+}
+
+static vector<uint32_t> generateShader(CorpusRandom& random, const CorpusOptions& options, const string& name)
+{
+	vector<uint32_t> capabilities, imports, memoryModel, entryPoints, executionModes;
+	vector<uint32_t> debugStrings, debugNames, annotations, types, functions;
+
+	uint32_t nextId = 1;
+	auto newId = [&]() { return nextId++; };
+
+	const bool bDebug = random.chance(options.debug);
+	const bool bCompute = options.compute > 0.0 && random.chance(options.compute);
+
+	emit(capabilities, kOpCapability, { 1 }); // Shader
+	const uint32_t glsl = newId();
+	emit(imports, kOpExtInstImport, concat({ glsl }, stringWords("GLSL.std.450")));
+	emit(memoryModel, kOpMemoryModel, { 0, 1 }); // Logical GLSL450
+
+	// Types
+	const uint32_t tVoid = newId(), tFunction = newId(), tFloat = newId(), tVec4 = newId(), tInt = newId();
+	emit(types, kOpTypeVoid, { tVoid });
+	emit(types, kOpTypeFunction, { tFunction, tVoid });
+	emit(types, kOpTypeFloat, { tFloat, 32 });
+	emit(types, kOpTypeVector, { tVec4, tFloat, 4 });
+	emit(types, kOpTypeInt, { tInt, 32, 1 });
+
+	// Uniform block of vec4 members
+	const uint32_t memberCount = 2 + random.below(6);
+	const uint32_t tBlock = newId();
+	emit(types, kOpTypeStruct, concat({ tBlock }, vector<uint32_t>(memberCount, tVec4)));
+	emit(annotations, kOpDecorate, { tBlock, kDecorationBlock });
+	for (uint32_t m = 0; m < memberCount; ++m)
+	{
+		emit(annotations, kOpMemberDecorate, { tBlock, m, kDecorationOffset, m * 16 });
+	}
+
+	const uint32_t tPtrInput = newId(), tPtrOutput = newId(), tPtrBlock = newId(), tPtrUniformVec4 = newId(), tPtrFunction = newId();
+	emit(types, kOpTypePointer, { tPtrInput, kStorageInput, tVec4 });
+	emit(types, kOpTypePointer, { tPtrOutput, kStorageOutput, tVec4 });
+	emit(types, kOpTypePointer, { tPtrBlock, kStorageUniform, tBlock });
+	emit(types, kOpTypePointer, { tPtrUniformVec4, kStorageUniform, tVec4 });
+	emit(types, kOpTypePointer, { tPtrFunction, kStorageFunction, tVec4 });
+
+	// Constants
+	vector<uint32_t> floatConstants, intConstants;
+	static const float kFloats[] = { 0.0f, 1.0f, 0.5f, 2.0f, 0.25f, 3.14159265f, 2.2f, 0.0031308f, 12.92f, 1.055f };
+	const uint32_t floatCount = 3 + random.below(8);
+	for (uint32_t i = 0; i < floatCount; ++i)
+	{
+		float value = kFloats[random.below(sizeof(kFloats) / sizeof(kFloats[0]))];
+		uint32_t bits;
+		memcpy(&bits, &value, 4);
+		uint32_t id = newId();
+		emit(types, kOpConstant, { tFloat, id, bits });
+		floatConstants.push_back(id);
+	}
+	for (uint32_t i = 0; i < memberCount; ++i)
+	{
+		uint32_t id = newId();
+		emit(types, kOpConstant, { tInt, id, i });
+		intConstants.push_back(id);
+	}
+
+	// Local size of compute shaders as glslang emits it for local_size_x_id and local_size_y_id, and
+	// a spec constant that nothing uses
+	if (bCompute)
+	{
+		const uint32_t tUint = newId(), tUvec3 = newId();
+		emit(types, kOpTypeInt, { tUint, 32, 0 });
+		emit(types, kOpTypeVector, { tUvec3, tUint, 3 });
+
+		const uint32_t sizeX = newId(), sizeY = newId(), sizeZ = newId(), workgroupSize = newId(), unused = newId();
+		emit(types, kOpSpecConstant, { tUint, sizeX, 8 });
+		emit(types, kOpSpecConstant, { tUint, sizeY, 8 });
+		emit(types, kOpConstant, { tUint, sizeZ, 1 });
+		emit(types, kOpSpecConstantComposite, { tUvec3, workgroupSize, sizeX, sizeY, sizeZ });
+		emit(types, kOpSpecConstant, { tInt, unused, 1 + random.below(16) });
+		emit(annotations, kOpDecorate, { sizeX, kDecorationSpecId, 0 });
+		emit(annotations, kOpDecorate, { sizeY, kDecorationSpecId, 1 });
+		emit(annotations, kOpDecorate, { workgroupSize, kDecorationBuiltIn, kBuiltInWorkgroupSize });
+		emit(annotations, kOpDecorate, { unused, kDecorationSpecId, 2 });
+	}
+
+	// Interface and uniform variables, compute shaders read uniform members instead of inputs and
+	// write a private variable
+	const uint32_t inputCount = 1 + random.below(3);
+	vector<uint32_t> inputs;
+	for (uint32_t i = 0; i < inputCount && !bCompute; ++i)
+	{
+		uint32_t id = newId();
+		emit(types, kOpVariable, { tPtrInput, id, kStorageInput });
+		emit(annotations, kOpDecorate, { id, kDecorationLocation, i });
+		inputs.push_back(id);
+	}
+	const uint32_t output = newId();
+	if (bCompute)
+	{
+		const uint32_t tPtrPrivate = newId();
+		emit(types, kOpTypePointer, { tPtrPrivate, kStoragePrivate, tVec4 });
+		emit(types, kOpVariable, { tPtrPrivate, output, kStoragePrivate });
+	}
+	else
+	{
+		emit(types, kOpVariable, { tPtrOutput, output, kStorageOutput });
+		emit(annotations, kOpDecorate, { output, kDecorationLocation, 0 });
+	}
+
+	const uint32_t ubo = newId();
+	emit(types, kOpVariable, { tPtrBlock, ubo, kStorageUniform });
+	emit(annotations, kOpDecorate, { ubo, kDecorationDescriptorSet, 0 });
+	emit(annotations, kOpDecorate, { ubo, kDecorationBinding, 0 });
+
+	// Entry point
+	const uint32_t main = newId();
+	if (bCompute)
+	{
+		emit(entryPoints, kOpEntryPoint, concat({ kExecutionModelGLCompute, main }, stringWords("main")));
+		emit(executionModes, kOpExecutionMode, { main, kExecutionModeLocalSize, 8, 8, 1 });
+	}
+	else
+	{
+		emit(entryPoints, kOpEntryPoint, concat(concat({ kExecutionModelFragment, main }, stringWords("main")), concat(inputs, { output })));
+		emit(executionModes, kOpExecutionMode, { main, kExecutionModeOriginUpperLeft });
+	}
+
+	uint32_t file = 0;
+	if (bDebug)
+	{
+		file = newId();
+		emit(debugStrings, kOpString, concat({ file }, stringWords(name + (bCompute ? ".comp" : ".frag"))));
+		emit(debugStrings, kOpSource, { 2, 450, file }); // GLSL 450
+		emit(debugNames, kOpName, concat({ main }, stringWords("main")));
+		emit(debugNames, kOpName, concat({ tBlock }, stringWords("Params")));
+		for (uint32_t m = 0; m < memberCount; ++m)
+		{
+			emit(debugNames, kOpMemberName, concat({ tBlock, m }, stringWords("param" + to_string(m))));
+		}
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			emit(debugNames, kOpName, concat({ inputs[i] }, stringWords("inValue" + to_string(i))));
+		}
+		emit(debugNames, kOpName, concat({ output }, stringWords(bCompute ? "result" : "outColor")));
+		emit(debugNames, kOpName, concat({ ubo }, stringWords("params")));
+	}
+
+	// Function body
+	emit(functions, kOpFunction, { tVoid, main, 0, tFunction });
+	emit(functions, kOpLabel, { newId() });
+
+	const uint32_t localCount = 1 + random.below(3);
+	vector<uint32_t> locals;
+	for (uint32_t i = 0; i < localCount; ++i)
+	{
+		uint32_t id = newId();
+		emit(functions, kOpVariable, { tPtrFunction, id, kStorageFunction });
+		locals.push_back(id);
+		if (bDebug) emit(debugNames, kOpName, concat({ id }, stringWords("local" + to_string(i))));
+	}
+
+	vector<uint32_t> values;
+	auto addValue = [&](uint32_t id) {
+		values.push_back(id);
+		if (values.size() > 12) values.erase(values.begin());
+	};
+	auto pickValue = [&]() { return values[values.size() - 1 - random.below((uint32_t)min<size_t>(values.size(), 6))]; };
+	auto relaxed = [&](uint32_t id) {
+		if (random.chance(options.decorations)) emit(annotations, kOpDecorate, { id, kDecorationRelaxedPrecision });
+	};
+
+	for (uint32_t input : inputs)
+	{
+		uint32_t id = newId();
+		emit(functions, kOpLoad, { tVec4, id, input });
+		addValue(id);
+	}
+	for (uint32_t i = 0; i < inputCount && bCompute; ++i)
+	{
+		uint32_t pointer = newId(), id = newId();
+		emit(functions, kOpAccessChain, { tPtrUniformVec4, pointer, ubo, intConstants[i % memberCount] });
+		emit(functions, kOpLoad, { tVec4, id, pointer });
+		addValue(id);
+	}
+
+	double mixTotal = 0.0;
+	for (double weight : options.mix) mixTotal += weight;
+
+	const size_t bodyCount = options.instructions / 2 + random.below((uint32_t)options.instructions + 1);
+	uint32_t line = 1;
+	for (size_t n = 0; n < bodyCount; ++n)
+	{
+		if (bDebug && random.chance(0.25)) emit(functions, kOpLine, { file, line += 1 + random.below(3), 5 + random.below(20) });
+
+		double pick = random.unit() * mixTotal;
+		int opClass = 0;
+		while (opClass < kOpClassCount - 1 && pick >= options.mix[opClass]) pick -= options.mix[opClass++];
+
+		uint32_t id = newId();
+		switch (opClass)
+		{
+		case kArith:
+		{
+			static const uint32_t kArithOps[] = { kOpFAdd, kOpFSub, kOpFMul, kOpFMul, kOpFAdd, kOpFDiv, kOpFNegate, kOpVectorTimesScalar };
+			uint32_t op = kArithOps[random.below(sizeof(kArithOps) / sizeof(kArithOps[0]))];
+			if (op == kOpFNegate) emit(functions, op, { tVec4, id, pickValue() });
+			else if (op == kOpVectorTimesScalar) emit(functions, op, { tVec4, id, pickValue(), floatConstants[random.below((uint32_t)floatConstants.size())] });
+			else emit(functions, op, { tVec4, id, pickValue(), pickValue() });
+			relaxed(id);
+			break;
+		}
+		case kShuffle:
+		{
+			// Mostly swizzles of one vector, like compilers emit
+			const uint32_t range = random.chance(0.8) ? 4 : 8;
+			emit(functions, kOpVectorShuffle, { tVec4, id, pickValue(), pickValue(), random.below(range), random.below(range), random.below(range), random.below(range) });
+			break;
+		}
+		case kComposite:
+		{
+			vector<uint32_t> components;
+			for (int c = 0; c < 4; ++c)
+			{
+				uint32_t component = newId();
+				emit(functions, kOpCompositeExtract, { tFloat, component, pickValue(), random.below(4) });
+				components.push_back(component);
+			}
+			emit(functions, kOpCompositeConstruct, concat({ tVec4, id }, components));
+			break;
+		}
+		case kExtInst:
+		{
+			static const uint32_t kUnary[] = { 4, 8, 10, 13, 14, 27, 31, 69 };	// FAbs Floor Fract Sin Cos Exp Sqrt Normalize
+			static const uint32_t kBinary[] = { 26, 37, 40, 48 };				// Pow FMin FMax Step
+			if (random.chance(0.6)) emit(functions, kOpExtInst, { tVec4, id, glsl, kUnary[random.below(8)], pickValue() });
+			else emit(functions, kOpExtInst, { tVec4, id, glsl, kBinary[random.below(4)], pickValue(), pickValue() });
+			relaxed(id);
+			break;
+		}
+		case kMemory:
+		{
+			uint32_t local = locals[random.below((uint32_t)locals.size())];
+			emit(functions, kOpStore, { local, pickValue() });
+			emit(functions, kOpLoad, { tVec4, id, local });
+			break;
+		}
+		case kDot:
+		{
+			uint32_t dot = newId();
+			emit(functions, kOpDot, { tFloat, dot, pickValue(), pickValue() });
+			emit(functions, kOpCompositeConstruct, { tVec4, id, dot, dot, dot, dot });
+			break;
+		}
+		case kUniform:
+		{
+			uint32_t pointer = newId();
+			emit(functions, kOpAccessChain, { tPtrUniformVec4, pointer, ubo, intConstants[random.below(memberCount)] });
+			emit(functions, kOpLoad, { tVec4, id, pointer });
+			break;
+		}
+		}
+		addValue(id);
+	}
+
+	emit(functions, kOpStore, { output, values.back() });
+	emit(functions, kOpReturn, {});
+	emit(functions, kOpFunctionEnd, {});
+
+	vector<uint32_t> words = { 0x07230203, 0x00010000, 0, nextId, 0 };
+	for (const auto* section : { &capabilities, &imports, &memoryModel, &entryPoints, &executionModes, &debugStrings, &debugNames, &annotations, &types, &functions })
+	{
+		words.insert(words.end(), section->begin(), section->end());
+	}
+	return words;
+}
+
+static bool parseMix(const string& text, CorpusOptions& options)
+{
+	for (double& weight : options.mix) weight = 0.0;
+
+	istringstream mix(text);
+	string entry;
+	while (getline(mix, entry, ','))
+	{
+		size_t equals = entry.find('=');
+		if (equals == string::npos) return false;
+
+		string name = entry.substr(0, equals);
+		int opClass = 0;
+		while (opClass < kOpClassCount && name != kOpClassNames[opClass]) opClass++;
+		if (opClass == kOpClassCount) return false;
+
+		options.mix[opClass] = atof(entry.c_str() + equals + 1);
+	}
+
+	double total = 0.0;
+	for (double weight : options.mix) total += weight;
+	return total > 0.0;
+}
+
+int main(int argc, char* argv[])
+{
+	CorpusOptions options;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		string arg = argv[i];
+		if (i + 1 >= argc)
+		{
+			cerr << "Missing value for: " << arg << endl;
+			return 1;
+		}
+		string value = argv[++i];
+
+		if (arg == "--count") options.count = strtoull(value.c_str(), nullptr, 10);
+		else if (arg == "--out") options.outDir = value;
+		else if (arg == "--seed") options.seed = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+		else if (arg == "--instructions") options.instructions = strtoull(value.c_str(), nullptr, 10);
+		else if (arg == "--decorations") options.decorations = atof(value.c_str());
+		else if (arg == "--debug") options.debug = atof(value.c_str());
+		else if (arg == "--duplicates") options.duplicates = atof(value.c_str());
+		else if (arg == "--compute") options.compute = atof(value.c_str());
+		else if (arg == "--mix")
+		{
+			if (!parseMix(value, options))
+			{
+				cerr << "Invalid op mix: " << value << endl;
+				return 1;
+			}
+		}
+		else
+		{
+			cerr << "Unknown option: " << arg << endl;
+			return 1;
+		}
+	}
+
+	error_code ec;
+	fs::create_directories(options.outDir, ec);
+
+	CorpusRandom random(options.seed);
+	vector<vector<uint32_t>> shaders;
+	size_t totalBytes = 0, duplicateCount = 0;
+
+	const int nameDigits = (int)max<size_t>(5, to_string(options.count).size());
+	for (size_t i = 0; i < options.count; ++i)
+	{
+		string name = to_string(i);
+		name = "shader_" + string(nameDigits - name.size(), '0') + name;
+
+		// Duplicates repeat an earlier module as is, like the same shader built for several passes
+		if (!shaders.empty() && random.chance(options.duplicates))
+		{
+			shaders.push_back(shaders[random.below((uint32_t)shaders.size())]);
+			duplicateCount++;
+		}
+		else
+		{
+			shaders.push_back(generateShader(random, options, name));
+		}
+
+		const vector<uint32_t>& words = shaders.back();
+		ofstream output(fs::path(options.outDir) / (name + ".spv"), ios::binary);
+		output.write((const char*)words.data(), words.size() * 4);
+		if (!output)
+		{
+			cerr << "Cannot write: " << name << endl;
+			return 1;
+		}
+		totalBytes += words.size() * 4;
+
+		// Memory stays flat with very large corpora, duplicates come from a recent window
+		if (shaders.size() > 1024) shaders.erase(shaders.begin());
+	}
+
+	cout << "Wrote " << options.count << " shaders (" << duplicateCount << " duplicates), " << totalBytes << " bytes to " << options.outDir << endl;
+	return 0;
+}
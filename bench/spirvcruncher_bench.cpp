@@ -0,0 +1,344 @@
+﻿// spirvcruncher_bench.cpp - benchmark of encode, analysis, template stripping, header emission and decode
+//
+// (c) 2025 Ossi Luoto
+//
+// Usage: spirvcruncher_bench [--min-time <seconds>] <shader.spv | directory> ...
+//
+// Throughput is reported against SPIR-V bytes for encode and decode stages, and against generated text
+// bytes for stripping and emission. ns/instr is time per SPIR-V instruction of the whole corpus.
+
+#include "smolv.h"
+#include "smolv_template.h"
+#include "crunchencoder.h"
+#include "crunchtemplate.h"
+#include "crunchheader.h"
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+using namespace std;
+using namespace smolv;
+namespace fs = std::filesystem;
+
+// Generated decrunch (spirvcruncher --decoder-only all), compiled in benchdecrunch.cpp
+void decrunch(const uint8_t* packed_bytes, const uint8_t* packed_bytes_end, uint32_t spvVersion, uint32_t spvBound, uint8_t* spirvCode);
+
+// Same with group varints (spirvcruncher --decoder-only all.og), compiled in benchdecrunchgroup.cpp
+void decrunch_groupvarint(const uint8_t* packed_bytes, const uint8_t* packed_bytes_end, uint32_t spvVersion, uint32_t spvBound, uint8_t* spirvCode);
+
+using BenchClock = chrono::steady_clock;
+
+struct BenchShader {
+	string name;
+	ByteArray spirv;
+	ByteArray smolv;
+	size_t instructions;
+	uint32_t maxOp;
+};
+
+// TinyDecode reads its op table without range checks, extended ops (ray tracing etc.) break it
+static const uint32_t kTinyDecodeOpsCount = 367;
+
+static double minTime = 0.25;	// seconds per measured batch
+static volatile size_t benchSink = 0;
+
+// Keeps results alive, so that the measured work isn't optimized away
+static void keep(size_t value)
+{
+	benchSink = benchSink + value;
+}
+
+static size_t countInstructions(const ByteArray& spirv, uint32_t& maxOp)
+{
+	size_t count = 0;
+	maxOp = 0;
+	size_t offset = 5 * 4;
+	while (offset + 4 <= spirv.size())
+	{
+		uint32_t word = spirv[offset] | (spirv[offset + 1] << 8) | (spirv[offset + 2] << 16) | ((uint32_t)spirv[offset + 3] << 24);
+		uint32_t len = word >> 16;
+		if (len == 0) break;
+		maxOp = max(maxOp, word & 0xFFFF);
+		offset += len * 4;
+		count++;
+	}
+	return count;
+}
+
+static uint32_t readWord(const ByteArray& data, size_t index)
+{
+	return data[index * 4] | (data[index * 4 + 1] << 8) | (data[index * 4 + 2] << 16) | ((uint32_t)data[index * 4 + 3] << 24);
+}
+
+static bool loadShader(const fs::path& path, vector<BenchShader>& shaders)
+{
+	ifstream input(path, ios::binary);
+	if (!input) return false;
+
+	BenchShader shader;
+	shader.name = path.stem().string();
+	shader.spirv.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+	if (shader.spirv.size() < 20 || readWord(shader.spirv, 0) != 0x07230203) return false;
+
+	shader.instructions = countInstructions(shader.spirv, shader.maxOp);
+	shaders.push_back(shader);
+	return true;
+}
+
+// Seconds per call: call count doubles until a batch takes minTime, best of three batches
+static double measure(const function<void()>& func)
+{
+	func(); // warm up
+
+	size_t calls = 1;
+	double batchTime = 0.0;
+	for (;;)
+	{
+		auto start = BenchClock::now();
+		for (size_t i = 0; i < calls; ++i) func();
+		batchTime = chrono::duration<double>(BenchClock::now() - start).count();
+		if (batchTime >= minTime) break;
+		calls *= 2;
+	}
+
+	double best = batchTime / calls;
+	for (int batch = 0; batch < 2; ++batch)
+	{
+		auto start = BenchClock::now();
+		for (size_t i = 0; i < calls; ++i) func();
+		best = min(best, chrono::duration<double>(BenchClock::now() - start).count() / calls);
+	}
+	return best;
+}
+
+static void printResult(const string& stage, double seconds, size_t bytes, size_t instructions)
+{
+	cout << "  " << left << setw(28) << stage << right << fixed
+		<< setw(12) << setprecision(1) << (double)bytes / seconds / 1000000.0
+		<< setw(12) << setprecision(2) << seconds * 1e9 / (double)instructions
+		<< setw(14) << setprecision(1) << seconds * 1e6 << "\n";
+}
+
+// Compare decoded SPIR-V, decrunch doesn't write generator and schema words
+static bool checkDecoded(const BenchShader& shader, const ByteArray& decoded, bool bSkipGeneratorSchema, const char* decoder)
+{
+	bool bOk = decoded.size() == shader.spirv.size();
+	for (size_t i = 0; bOk && i < shader.spirv.size() / 4; ++i)
+	{
+		if (bSkipGeneratorSchema && (i == 2 || i == 4)) continue;
+		bOk = readWord(decoded, i) == readWord(shader.spirv, i);
+	}
+	if (!bOk) cerr << decoder << " output differs: " << shader.name << endl;
+	return bOk;
+}
+
+int main(int argc, char* argv[])
+{
+	vector<BenchShader> shaders;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		string arg = argv[i];
+		if (arg == "--min-time" && i + 1 < argc)
+		{
+			minTime = atof(argv[++i]);
+			continue;
+		}
+
+		fs::path path(arg);
+		if (fs::is_directory(path))
+		{
+			vector<fs::path> files;
+			for (const auto& entry : fs::directory_iterator(path))
+			{
+				if (entry.path().extension() == ".spv") files.push_back(entry.path());
+			}
+			sort(files.begin(), files.end());
+			for (const auto& file : files) loadShader(file, shaders);
+		}
+		else if (!loadShader(path, shaders))
+		{
+			cerr << "Failed to read: " << arg << endl;
+			return 1;
+		}
+	}
+
+	if (shaders.empty())
+	{
+		cerr << "Usage: " << argv[0] << " [--min-time <seconds>] <shader.spv | directory> ...\n";
+		return 1;
+	}
+
+	size_t spirvBytes = 0, instructions = 0;
+	bool bTinyDecode = true;
+	for (auto& shader : shaders)
+	{
+		spirvBytes += shader.spirv.size();
+		instructions += shader.instructions;
+		if (shader.maxOp >= kTinyDecodeOpsCount) bTinyDecode = false;
+		if (!Encode(shader.spirv.data(), shader.spirv.size(), shader.smolv))
+		{
+			cerr << "Failed to encode smolv: " << shader.name << endl;
+			return 1;
+		}
+	}
+
+	// Analysis and decoder spec of the corpus, as in spirvcruncher
+	DecodeAnalysis globalAnalysis;
+	for (const auto& shader : shaders)
+	{
+		ByteArray decoded(GetDecodedBufferSize(shader.smolv.data(), shader.smolv.size()));
+		DecodeAnalysis localAnalysis;
+		if (DecodeWithAnalysis(shader.smolv.data(), shader.smolv.size(), decoded.data(), decoded.size(), &localAnalysis))
+			mergeAnalysis(globalAnalysis, localAnalysis);
+	}
+
+	DecoderSpec decoderSpec;
+	decoderSpec.lookup = buildAnalysisLookup(globalAnalysis);
+
+	vector<EncodedShader> encodedShaders;
+	for (const auto& shader : shaders)
+	{
+		EncodedShader encoded;
+		encoded.name = shader.name;
+		encoded.spirv = shader.spirv;
+		encoded.smolv = shader.smolv;
+		encoded.decodedSize = shader.spirv.size();
+		encodedShaders.push_back(std::move(encoded));
+	}
+
+	// Decoders must agree with the input before timing them
+	vector<ByteArray> decoded(shaders.size());
+	for (size_t i = 0; i < shaders.size(); ++i)
+	{
+		decoded[i].assign(shaders[i].spirv.size(), 0);
+	}
+
+	// Group varint payloads of the same shaders, for decrunch with group varints
+	vector<ByteArray> groupVarints(shaders.size());
+	size_t groupVarintBytes = 0;
+	for (size_t i = 0; i < shaders.size(); ++i)
+	{
+		if (!crunchEncode(shaders[i].spirv, groupVarints[i], kCrunchEncodeFlagGroupVarint, getSmolvRemapTable()))
+		{
+			cerr << "Failed to encode group varints: " << shaders[i].name << endl;
+			return 1;
+		}
+		groupVarintBytes += groupVarints[i].size();
+	}
+
+	bool bOk = true;
+	for (size_t i = 0; i < shaders.size(); ++i)
+	{
+		const auto& shader = shaders[i];
+		const ByteArray& smolv = shader.smolv;
+
+		fill(decoded[i].begin(), decoded[i].end(), 0);
+		decrunch(smolv.data() + headerToSkip, smolv.data() + smolv.size(), readWord(shader.spirv, 1), readWord(shader.spirv, 3), decoded[i].data());
+		bOk &= checkDecoded(shader, decoded[i], true, "decrunch");
+
+		const ByteArray& groups = groupVarints[i];
+		fill(decoded[i].begin(), decoded[i].end(), 0);
+		decrunch_groupvarint(groups.data() + headerToSkip, groups.data() + groups.size(), readWord(shader.spirv, 1), readWord(shader.spirv, 3), decoded[i].data());
+		bOk &= checkDecoded(shader, decoded[i], true, "decrunch (group varint)");
+
+		fill(decoded[i].begin(), decoded[i].end(), 0);
+		bOk &= Decode(smolv.data(), smolv.size(), decoded[i].data(), decoded[i].size()) && checkDecoded(shader, decoded[i], false, "smolv::Decode");
+
+		if (bTinyDecode)
+		{
+			fill(decoded[i].begin(), decoded[i].end(), 0);
+			TinyDecode(smolv.data(), smolv.size(), decoded[i].data());
+			bOk &= checkDecoded(shader, decoded[i], false, "TinyDecode");
+		}
+	}
+	if (!bOk) return 1;
+
+	size_t smolvBytes = 0;
+	for (const auto& shader : shaders) smolvBytes += shader.smolv.size();
+
+	cout << "Corpus: " << shaders.size() << " shaders, " << spirvBytes << " bytes, " << instructions << " instructions\n";
+	cout << "Payloads: " << smolvBytes << " bytes smol-v, " << groupVarintBytes << " bytes with group varints\n\n";
+	cout << "  " << left << setw(28) << "stage" << right << setw(12) << "MB/s" << setw(12) << "ns/instr" << setw(14) << "us/corpus" << "\n";
+
+	OpRemapTable remapTable = buildOpRemapTable(globalAnalysis);
+	ByteArray smolvOut;
+
+	printResult("smolv::Encode", measure([&] {
+		for (const auto& shader : shaders) { Encode(shader.spirv.data(), shader.spirv.size(), smolvOut); keep(smolvOut.size()); }
+	}), spirvBytes, instructions);
+
+	printResult("crunchEncode (remap)", measure([&] {
+		for (const auto& shader : shaders) { crunchEncode(shader.spirv, smolvOut, 0, remapTable); keep(smolvOut.size()); }
+	}), spirvBytes, instructions);
+
+	printResult("DecodeWithAnalysis", measure([&] {
+		for (size_t i = 0; i < shaders.size(); ++i)
+		{
+			DecodeAnalysis analysis;
+			DecodeWithAnalysis(shaders[i].smolv.data(), shaders[i].smolv.size(), decoded[i].data(), decoded[i].size(), &analysis);
+			keep(analysis.SpvOps.size());
+		}
+	}), spirvBytes, instructions);
+
+	ostringstream decoderText;
+	writeDecoder(decoderText, decoderSpec);
+	printResult("writeDecoder (strip)", measure([&] {
+		ostringstream text;
+		writeDecoder(text, decoderSpec);
+		keep((size_t)text.tellp());
+	}), decoderText.str().size(), instructions);
+
+	ostringstream headerText;
+	generateUberHeader(headerText, decoderText.str(), encodedShaders, {}, {}, {}, {}, false);
+	printResult("generateUberHeader (emit)", measure([&] {
+		ostringstream text;
+		generateUberHeader(text, decoderText.str(), encodedShaders, {}, {}, {}, {}, false);
+		keep((size_t)text.tellp());
+	}), headerText.str().size(), instructions);
+
+	printResult("decrunch (generated)", measure([&] {
+		for (size_t i = 0; i < shaders.size(); ++i)
+		{
+			const ByteArray& smolv = shaders[i].smolv;
+			decrunch(smolv.data() + headerToSkip, smolv.data() + smolv.size(), readWord(shaders[i].spirv, 1), readWord(shaders[i].spirv, 3), decoded[i].data());
+		}
+	}), spirvBytes, instructions);
+
+	printResult("decrunch (group varint)", measure([&] {
+		for (size_t i = 0; i < shaders.size(); ++i)
+		{
+			const ByteArray& groups = groupVarints[i];
+			decrunch_groupvarint(groups.data() + headerToSkip, groups.data() + groups.size(), readWord(shaders[i].spirv, 1), readWord(shaders[i].spirv, 3), decoded[i].data());
+		}
+	}), spirvBytes, instructions);
+
+	printResult("smolv::Decode", measure([&] {
+		for (size_t i = 0; i < shaders.size(); ++i)
+			Decode(shaders[i].smolv.data(), shaders[i].smolv.size(), decoded[i].data(), decoded[i].size());
+	}), spirvBytes, instructions);
+
+	if (bTinyDecode)
+	{
+		printResult("TinyDecode", measure([&] {
+			for (size_t i = 0; i < shaders.size(); ++i)
+				TinyDecode(shaders[i].smolv.data(), shaders[i].smolv.size(), decoded[i].data());
+		}), spirvBytes, instructions);
+	}
+	else
+	{
+		cout << "  TinyDecode skipped, corpus has ops beyond its op table\n";
+	}
+
+	return 0;
+}
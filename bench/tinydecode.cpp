@@ -0,0 +1,10 @@
+﻿// tinydecode.cpp - smol-v TinyDecode from data/smolv_template.cpp for the benchmark
+//
+// (c) 2025 Ossi Luoto
+//
+// Own translation unit, because smolv_template.cpp defines SpvOp as an enum and the generated
+// decrunch as an integer type.
+
+#include <stddef.h>
+#include "smolv_template.h"
+#include "smolv_template.cpp"
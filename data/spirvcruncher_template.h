@@ -385,7 +385,9 @@ struct OpData
 	uint8_t varrest;	// should the rest of words be written in varint encoding?
 };
 #pragma data_seg(".kSpirvOpData")
+// >>>>> SPIRVCRUNCHER Replace Start >>>>> OpDataDeclaration
 static const OpData kSpirvOpData[] =
+// >>>>> SPIRVCRUNCHER Replace End >>>>> OpDataDeclaration
 {
 	// >>>>> SPIRVCRUNCHER Spv Start >>>>>
 		{0, 0, 0, 0}, // Nop
@@ -802,6 +804,67 @@ static uint32_t smolv_ReadVarint(const uint8_t*& data, const uint8_t* dataEnd)
 	return outVal;
 }
 
+// >>>>> SPIRVCRUNCHER Option Start >>>>> GroupVarint
+#include <string.h>
+
+// Group varint: a control byte of 2 bit byte counts, then four values in as many little endian
+// bytes, in the stream where the first of them is. All four are decoded when the first is needed,
+// each with one masked 4 byte load. Payload has 3 bytes of padding after the last group.
+struct smolv_GroupVarints
+{
+	uint32_t values[4];
+	uint32_t next;
+};
+
+inline uint32_t smolv_ReadGroupVarint(const uint8_t*& data, smolv_GroupVarints& group)
+{
+	if (group.next == 4)
+	{
+		const uint32_t control = *data++;
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			const uint32_t bytes = ((control >> (i * 2)) & 3) + 1;
+			uint32_t value;
+			memcpy(&value, data, 4);
+			group.values[i] = value & (0xFFFFFFFFu >> (32 - bytes * 8));
+			data += bytes;
+		}
+		group.next = 0;
+	}
+	return group.values[group.next++];
+}
+// >>>>> SPIRVCRUNCHER Option End >>>>> GroupVarint
+// >>>>> SPIRVCRUNCHER Option Start >>>>> HuffmanOps
+// Canonical Huffman op code from the op bit stream, highest bit first. Codes of each length are
+// consecutive and in dense table order, so the code minus the first code of its length is the
+// index among them.
+inline uint32_t smolv_ReadHuffmanOp(const uint8_t* bits, uint32_t& bitPos)
+{
+	uint32_t code = 0, first = 0, index = 0;
+	for (uint32_t len = 0; len < sizeof(kHuffmanLengthCounts) / sizeof(kHuffmanLengthCounts[0]); ++len)
+	{
+		code |= (bits[bitPos >> 3] >> (7 - (bitPos & 7))) & 1;
+		bitPos++;
+		const uint32_t count = kHuffmanLengthCounts[len];
+		if (code - first < count) return index + code - first;
+		index += count;
+		first = (first + count) << 1;
+		code <<= 1;
+	}
+	return 0;
+}
+// >>>>> SPIRVCRUNCHER Option End >>>>> HuffmanOps
+// >>>>> SPIRVCRUNCHER Option Start >>>>> Macros
+// End of a shared_macros run, back to the payload after the reference. Runs don't nest.
+inline bool smolv_MacroReturn(const uint8_t*& data, const uint8_t*& dataEnd, const uint8_t*& caller, const uint8_t*& callerEnd)
+{
+	if (!caller) return false;
+	data = caller;
+	dataEnd = callerEnd;
+	caller = nullptr;
+	return data < dataEnd;
+}
+// >>>>> SPIRVCRUNCHER Option End >>>>> Macros
 
 inline int32_t smolv_ZigDecode(uint32_t u)
 {
@@ -815,6 +878,7 @@ inline int32_t smolv_ZigDecode(uint32_t u)
 inline SpvOp smolv_RemapOp(SpvOp op)
 {
 #	define _SMOLV_SWAP_OP(op1,op2) if (op==op1) return op2; if (op==op2) return op1
+	// >>>>> SPIRVCRUNCHER Remap Start >>>>>
 	// >>>>> SPIRVCRUNCHER Block Start >>>>> SMOLSWAP_SpvOpDecorate
 	// _SMOLV_SWAP_OP(SpvOpDecorate, SpvOpNop); // 0: 24% SPIRVCRUNCHER skip on build
 	_SMOLV_SWAP_OP((SpvOp)71, (SpvOp)0); // 0: 24%
@@ -867,6 +931,7 @@ inline SpvOp smolv_RemapOp(SpvOp op)
 	// _SMOLV_SWAP_OP(SpvOpFNegate, SpvOpEntryPoint); // 15: 1.1% SPIRVCRUNCHER skip on build
 	_SMOLV_SWAP_OP((SpvOp)127, (SpvOp)15); // 15: 1.1%
 	// >>>>> SPIRVCRUNCHER Block End >>>>> SMOLSWAP_SpvOpFNegate
+	// >>>>> SPIRVCRUNCHER Remap End >>>>>
 #	undef _SMOLV_SWAP_OP
 	return op;
 }
@@ -903,8 +968,92 @@ inline uint32_t smolv_DecodeLen(SpvOp op, uint32_t len)
 	return len;
 }
 
+// >>>>> SPIRVCRUNCHER Option Start >>>>> Instrument
+// --------------------------------------------------------------------------------------------
+// Instrumented decrunch: per op counts, packed bytes read, SPIR-V words written and time spent.
+// Stats are summed over decrunch calls, ticks are rdtsc cycles or steady_clock ticks.
+
+#include <stdio.h>
+#include <string.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+inline uint64_t decrunch_Now() { return __rdtsc(); }
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+inline uint64_t decrunch_Now() { return __rdtsc(); }
+#else
+#include <chrono>
+inline uint64_t decrunch_Now() { return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count(); }
+#endif
+
+struct DecrunchOpStats
+{
+	uint64_t count;		// instructions
+	uint64_t bytes;		// packed bytes read
+	uint64_t words;		// SPIR-V words written
+	uint64_t ticks;
+};
+
+struct DecrunchStats
+{
+	DecrunchOpStats total;			// count is decrunch calls
+	DecrunchOpStats ops[0x10000];	// by op, VectorShuffleCompact as 13
+};
+
+// One definition for the program, so that the stats are the same wherever the header is included
+inline DecrunchStats decrunchStats;
+
+// Adds to the stats when leaving the scope, so that continue in the decode loop is counted too
+struct DecrunchStatsScope
+{
+	DecrunchOpStats& stats;
+	const uint8_t* const& packed_bytes;
+	const uint8_t* packedStart;
+	uint8_t* const& spirvCode;
+	uint8_t* spirvStart;
+	uint64_t start;
+
+	~DecrunchStatsScope()
+	{
+		stats.count++;
+		stats.bytes += packed_bytes - packedStart;
+		stats.words += (spirvCode - spirvStart) / 4;
+		stats.ticks += decrunch_Now() - start;
+	}
+};
+
+inline void decrunch_ResetStats()
+{
+	memset(&decrunchStats, 0, sizeof(decrunchStats));	// no 2 MB temporary on the stack
+}
+
+// CSV of ops in use, first row is the totals with op "all"
+inline void decrunch_DumpStatsCsv(FILE* file)
+{
+	fprintf(file, "op,count,bytes,words,ticks,ticks_per_instr\n");
+	const DecrunchOpStats& t = decrunchStats.total;
+	fprintf(file, "all,%llu,%llu,%llu,%llu,\n", (unsigned long long)t.count, (unsigned long long)t.bytes,
+		(unsigned long long)t.words, (unsigned long long)t.ticks);
+	for (uint32_t op = 0; op < 0x10000; ++op)
+	{
+		const DecrunchOpStats& s = decrunchStats.ops[op];
+		if (s.count == 0) continue;
+		fprintf(file, "%u,%llu,%llu,%llu,%llu,%.1f\n", op, (unsigned long long)s.count, (unsigned long long)s.bytes,
+			(unsigned long long)s.words, (unsigned long long)s.ticks, (double)s.ticks / (double)s.count);
+	}
+}
+
+// >>>>> SPIRVCRUNCHER Option End >>>>> Instrument
+// >>>>> SPIRVCRUNCHER Option Start >>>>> Variants
+// Decoded base shader of a variant payload, DECRUNCH_ALL_SHADERS sets it before each variant
+inline const uint32_t* decrunch_base;
+
+// >>>>> SPIRVCRUNCHER Option End >>>>> Variants
 void decrunch(const uint8_t* packed_bytes, const uint8_t* packed_bytes_end, uint32_t spvVersion, uint32_t spvBound, uint8_t* spirvCode)
 {
+// >>>>> SPIRVCRUNCHER Option Start >>>>> Instrument
+	DecrunchStatsScope callScope = { decrunchStats.total, packed_bytes, packed_bytes, spirvCode, spirvCode, decrunch_Now() };
+// >>>>> SPIRVCRUNCHER Option End >>>>> Instrument
 
 	// SPIR-V Header
 	*(uint32_t*)spirvCode = 0x07230203; // Magic number (mandatory)
@@ -918,21 +1067,152 @@ void decrunch(const uint8_t* packed_bytes, const uint8_t* packed_bytes_end, uint
 	uint32_t prevResult = 0;
 	uint32_t prevDecorate = 0;
 
+// >>>>> SPIRVCRUNCHER Option Start >>>>> HuffmanOps
+	// Op bit stream ahead of the other streams
+	const uint32_t opBitBytes = smolv_ReadVarint(packed_bytes, packed_bytes_end);
+	const uint8_t* opBits = packed_bytes;
+	uint32_t opBitPos = 0;
+	packed_bytes += opBitBytes;
+// >>>>> SPIRVCRUNCHER Option End >>>>> HuffmanOps
+
+	// Field cursors, all on the one stream unless the payload is columnar
+// >>>>> SPIRVCRUNCHER Replace Start >>>>> StreamCursors
+	const uint8_t*& typeStream = packed_bytes;
+	const uint8_t*& resultStream = packed_bytes;
+	const uint8_t*& operandStream = packed_bytes;
+	const uint8_t*& literalStream = packed_bytes;
+	const uint8_t*& memberStream = packed_bytes;
+// >>>>> SPIRVCRUNCHER Replace End >>>>> StreamCursors
+// >>>>> SPIRVCRUNCHER Option Start >>>>> SharedPrologue
+	const uint32_t* prologue = shared_prologue;
+// >>>>> SPIRVCRUNCHER Option End >>>>> SharedPrologue
+// >>>>> SPIRVCRUNCHER Option Start >>>>> Variants
+	const uint32_t* base = decrunch_base + 5;
+// >>>>> SPIRVCRUNCHER Option End >>>>> Variants
+// >>>>> SPIRVCRUNCHER Option Start >>>>> GroupVarint
+	smolv_GroupVarints operandGroups = { {}, 4 };
+	smolv_GroupVarints literalGroups = { {}, 4 };
+	packed_bytes_end -= 3;	// padding of the last group
+// >>>>> SPIRVCRUNCHER Option End >>>>> GroupVarint
+// >>>>> SPIRVCRUNCHER Option Start >>>>> CompactOps
+	uint32_t prevChainBase = 0;
+	uint32_t prevChainIndex = 0;
+// >>>>> SPIRVCRUNCHER Option End >>>>> CompactOps
+// >>>>> SPIRVCRUNCHER Option Start >>>>> Macros
+	const uint8_t* macroCaller = nullptr;
+	const uint8_t* macroCallerEnd = nullptr;
+// >>>>> SPIRVCRUNCHER Option End >>>>> Macros
+
+// >>>>> SPIRVCRUNCHER Replace Start >>>>> DecodeLoop
 	while (packed_bytes < packed_bytes_end)
+// >>>>> SPIRVCRUNCHER Replace End >>>>> DecodeLoop
 	{
+// >>>>> SPIRVCRUNCHER Option Start >>>>> Instrument
+		const uint8_t* instrStart = packed_bytes;
+		uint8_t* instrSpirvStart = spirvCode;
+		const uint64_t instrTime = decrunch_Now();
+// >>>>> SPIRVCRUNCHER Option End >>>>> Instrument
 		// read length + opcode
 		
 		SpvOp op;
 		
 		// Inline opt
 		uint32_t instrLen = smolv_ReadVarint(packed_bytes, packed_bytes_end); // , instrLen);
+// >>>>> SPIRVCRUNCHER Replace Start >>>>> OpLenSplit
 		op = (SpvOp)(((instrLen >> 4) & 0xFFF0) | (instrLen & 0xF));
 		instrLen = ((instrLen >> 20) << 4) | ((instrLen >> 4) & 0xF);
+// >>>>> SPIRVCRUNCHER Replace End >>>>> OpLenSplit
+// >>>>> SPIRVCRUNCHER Replace Start >>>>> OpRemapCall
 		op = smolv_RemapOp(op);
+// >>>>> SPIRVCRUNCHER Replace End >>>>> OpRemapCall
+// >>>>> SPIRVCRUNCHER Replace Start >>>>> DecodeLenCall
 		instrLen = smolv_DecodeLen(op, instrLen);
+// >>>>> SPIRVCRUNCHER Replace End >>>>> DecodeLenCall
+// >>>>> SPIRVCRUNCHER Option Start >>>>> Macros
+		// Run of instructions from shared_macros, decoded with the state before the reference
+		if (op == (SpvOp)40)
+		{
+			const uint32_t index = smolv_ReadVarint(literalStream, packed_bytes_end);
+			macroCaller = packed_bytes;
+			macroCallerEnd = packed_bytes_end;
+			packed_bytes = shared_macros + shared_macro_offsets[index];
+			packed_bytes_end = shared_macros + shared_macro_offsets[index + 1];
+			continue;
+		}
+// >>>>> SPIRVCRUNCHER Option End >>>>> Macros
 
 		// const bool wasSwizzle = (op == SpvOpVectorShuffleCompact); // SPIRVCRUNCHER skip on build
 		const bool wasSwizzle = (op == (SpvOp)13);
+// >>>>> SPIRVCRUNCHER Option Start >>>>> Instrument
+		DecrunchStatsScope instrScope = { decrunchStats.ops[op], packed_bytes, instrStart, spirvCode, instrSpirvStart, instrTime };
+// >>>>> SPIRVCRUNCHER Option End >>>>> Instrument
+// >>>>> SPIRVCRUNCHER Option Start >>>>> SharedPrologue
+		// Shared declarations as (skip, take) instruction runs of shared_prologue
+		if (op == (SpvOp)18)
+		{
+			for (uint32_t run = 1; run < instrLen; run += 2)
+			{
+				uint32_t skip = smolv_ReadVarint(literalStream, packed_bytes_end);
+				uint32_t take = smolv_ReadVarint(literalStream, packed_bytes_end);
+				for (; skip; --skip) prologue += *prologue >> 16;
+				for (; take; --take)
+				{
+					for (uint32_t w = *prologue >> 16; w; --w) smolv_Write4(spirvCode, *prologue++);
+				}
+			}
+			continue;
+		}
+// >>>>> SPIRVCRUNCHER Option End >>>>> SharedPrologue
+// >>>>> SPIRVCRUNCHER Option Start >>>>> Variants
+		// Instructions the same in the base shader as (skip, take) instruction runs of the base
+		if (op == (SpvOp)9)
+		{
+			for (uint32_t run = 1; run < instrLen; run += 2)
+			{
+				uint32_t skip = smolv_ReadVarint(literalStream, packed_bytes_end);
+				uint32_t take = smolv_ReadVarint(literalStream, packed_bytes_end);
+				for (; skip; --skip) base += *base >> 16;
+				for (; take; --take)
+				{
+					for (uint32_t w = *base >> 16; w; --w) smolv_Write4(spirvCode, *base++);
+				}
+			}
+			continue;
+		}
+// >>>>> SPIRVCRUNCHER Option End >>>>> Variants
+// >>>>> SPIRVCRUNCHER Option Start >>>>> CompactOps
+		// Compact CompositeExtract (#76), CompositeConstruct (#85) and AccessChain (#58)
+		if (op == (SpvOp)76 || op == (SpvOp)85 || op == (SpvOp)58)
+		{
+			smolv_Write4(spirvCode, (instrLen << 16) | (op == (SpvOp)76 ? 81 : op == (SpvOp)85 ? 80 : 65));
+			smolv_Write4(spirvCode, smolv_ReadVarint(typeStream, packed_bytes_end));
+			prevResult += smolv_ZigDecode(smolv_ReadVarint(resultStream, packed_bytes_end));
+			smolv_Write4(spirvCode, prevResult);
+			if (op == (SpvOp)85)
+			{
+				// components 1-4 results back, two bits each
+				uint32_t deltas = *operandStream++;
+				for (uint32_t i = 3; i < instrLen; ++i, deltas >>= 2) smolv_Write4(spirvCode, prevResult - 1 - (deltas & 3));
+				continue;
+			}
+			val = smolv_ReadVarint(operandStream, packed_bytes_end);
+			if (op == (SpvOp)76)
+			{
+				// composite relative to result, index below 4
+				smolv_Write4(spirvCode, prevResult - smolv_ZigDecode(val >> 2));
+				smolv_Write4(spirvCode, val & 3);
+			}
+			else
+			{
+				// index relative to the previous compact chain, base only when it changes
+				if (!(val & 1)) prevChainBase = smolv_ReadVarint(operandStream, packed_bytes_end);
+				prevChainIndex += smolv_ZigDecode(val >> 1);
+				smolv_Write4(spirvCode, prevChainBase);
+				smolv_Write4(spirvCode, prevChainIndex);
+			}
+			continue;
+		}
+// >>>>> SPIRVCRUNCHER Option End >>>>> CompactOps
 // >>>>> SPIRVCRUNCHER Block Start >>>>> wasSwizzleVectorSuffle
 		if (wasSwizzle) {
 			// op = SpvOpVectorShuffle; // SPIRVCRUNCHER skip on build
@@ -942,10 +1222,12 @@ void decrunch(const uint8_t* packed_bytes, const uint8_t* packed_bytes_end, uint
 		smolv_Write4(spirvCode, (instrLen << 16) | op);
 
 		// We need fallback for extended op-codes - f.ex. raytrace stuff can be in thousands
+// >>>>> SPIRVCRUNCHER Replace Start >>>>> OpDataLookup
 		OpData opInfo = { 0, 0, 0, 0 };
 		if (op < (sizeof(kSpirvOpData) / sizeof(kSpirvOpData[0]))) {
 			opInfo = kSpirvOpData[op];
 		}
+// >>>>> SPIRVCRUNCHER Replace End >>>>> OpDataLookup
 
 		size_t ioffs = 1;
 
@@ -953,7 +1235,7 @@ void decrunch(const uint8_t* packed_bytes, const uint8_t* packed_bytes_end, uint
 // >>>>> SPIRVCRUNCHER Block Start >>>>> smolv_OpHasType
 		if (opInfo.hasType != 0)
 		{
-			val = smolv_ReadVarint(packed_bytes, packed_bytes_end);
+			val = smolv_ReadVarint(typeStream, packed_bytes_end);
 			smolv_Write4(spirvCode, val);
 			ioffs++;
 		}
@@ -962,19 +1244,64 @@ void decrunch(const uint8_t* packed_bytes, const uint8_t* packed_bytes_end, uint
 // >>>>> SPIRVCRUNCHER Block Start >>>>> smolv_OpHasResult
 		if (opInfo.hasResult != 0)
 		{
-			val = smolv_ReadVarint(packed_bytes, packed_bytes_end);
+			val = smolv_ReadVarint(resultStream, packed_bytes_end);
 			val = prevResult + smolv_ZigDecode(val);
 			smolv_Write4(spirvCode, val);
 			prevResult = val;
 			ioffs++;
 		}
 // >>>>> SPIRVCRUNCHER Block End >>>>> smolv_OpHasResult
+// >>>>> SPIRVCRUNCHER Option Start >>>>> ConstantLiterals
+		// OpConstant literals as zigzag varints, float transform varints or raw words, the form is in
+		// the low bits of the type written above
+		if (op == (SpvOp)43)
+		{
+			uint32_t* constantType = (uint32_t*)spirvCode - 2;
+			const uint32_t form = *constantType & 3;
+			*constantType >>= 2;
+			for (; ioffs < instrLen; ++ioffs)
+			{
+				if (form == 2)
+				{
+					val = (literalStream[0]) | (literalStream[1] << 8) | (literalStream[2] << 16) | (literalStream[3] << 24);
+					literalStream += 4;
+				}
+				else
+				{
+					val = smolv_ReadVarint(literalStream, packed_bytes_end);
+					if (form == 0) val = smolv_ZigDecode(val);
+					else
+					{
+						// sign, exponent delta from that of 1.0, mantissa bits reversed
+						uint32_t bits = (val << 31) | (((127 + smolv_ZigDecode((val >> 1) & 0xFF)) & 0xFF) << 23);
+						for (int b = 9; b < 32; ++b) bits |= ((val >> b) & 1) << (31 - b);
+						val = bits;
+					}
+				}
+				smolv_Write4(spirvCode, val);
+			}
+			continue;
+		}
+// >>>>> SPIRVCRUNCHER Option End >>>>> ConstantLiterals
+// >>>>> SPIRVCRUNCHER Option Start >>>>> StringTable
+		// Literal string as an index to shared_strings, the other operands as varints
+		if (op == (SpvOp)4 || op == (SpvOp)5 || op == (SpvOp)6 || op == (SpvOp)7 || op == (SpvOp)10 || op == (SpvOp)11 || op == (SpvOp)15 || op == (SpvOp)330)
+		{
+			const uint32_t stringOffs = (op == (SpvOp)6 || op == (SpvOp)15) ? 3 : (op == (SpvOp)5 || op == (SpvOp)7 || op == (SpvOp)11) ? 2 : 1;
+			for (; ioffs < stringOffs; ++ioffs) smolv_Write4(spirvCode, smolv_ReadVarint(literalStream, packed_bytes_end));
+			const uint32_t* string = shared_strings;
+			for (uint32_t index = smolv_ReadVarint(literalStream, packed_bytes_end); index; --index) string += *string + 1;
+			for (uint32_t w = *string++; w; --w, ++ioffs) smolv_Write4(spirvCode, *string++);
+			for (; ioffs < instrLen; ++ioffs) smolv_Write4(spirvCode, smolv_ReadVarint(literalStream, packed_bytes_end));
+			continue;
+		}
+// >>>>> SPIRVCRUNCHER Option End >>>>> StringTable
 		// Decorate: IDs relative to previous decorate
 // >>>>> SPIRVCRUNCHER Block Start >>>>> SpvDecorate
 		//if (op == SpvOpDecorate || op == SpvOpMemberDecorate) // SPIRVCRUNCHER skip on build
 		if (op == (SpvOp)71 || op == (SpvOp)72)
 		{
-			val = smolv_ReadVarint(packed_bytes, packed_bytes_end);
+			val = smolv_ReadVarint(operandStream, packed_bytes_end);
 			// "before zero" version did not use zig encoding for the value
 			val = prevDecorate + (smolv_ZigDecode(val));
 			smolv_Write4(spirvCode, val);
@@ -987,24 +1314,24 @@ void decrunch(const uint8_t* packed_bytes, const uint8_t* packed_bytes_end, uint
 		// if (op == SpvOpMemberDecorate) // SPIRVCRUNCHER skip on build
 		if (op == (SpvOp)72)
 		{
-			int count = *packed_bytes++;
+			int count = *memberStream++;
 			int prevIndex = 0;
 			int prevOffset = 0;
 			for (int m = 0; m < count; ++m)
 			{
 				// read member index
-				uint32_t memberIndex = smolv_ReadVarint(packed_bytes, packed_bytes_end);
+				uint32_t memberIndex = smolv_ReadVarint(memberStream, packed_bytes_end);
 				memberIndex += prevIndex;
 				prevIndex = memberIndex;
 
 				// decoration (and length if not common/known)
-				uint32_t memberDec = smolv_ReadVarint(packed_bytes, packed_bytes_end);
+				uint32_t memberDec = smolv_ReadVarint(memberStream, packed_bytes_end);
 				const int knownExtraOps = smolv_DecorationExtraOps(memberDec);
 				uint32_t memberLen;
 	// >>>>> SPIRVCRUNCHER BlockInBlock Start >>>>> BlockInBlock_knownExtraOpsCondition
 				if (knownExtraOps == -1)
 				{
-					memberLen = smolv_ReadVarint(packed_bytes, packed_bytes_end);
+					memberLen = smolv_ReadVarint(memberStream, packed_bytes_end);
 					memberLen += 4;
 				}
 				else
@@ -1023,7 +1350,7 @@ void decrunch(const uint8_t* packed_bytes, const uint8_t* packed_bytes_end, uint
 				// Special case for Offset decorations
 				if (memberDec == 35) // Offset
 				{
-					val = smolv_ReadVarint(packed_bytes, packed_bytes_end);
+					val = smolv_ReadVarint(memberStream, packed_bytes_end);
 					val += prevOffset;
 					smolv_Write4(spirvCode, val);
 					prevOffset = val;
@@ -1033,7 +1360,7 @@ void decrunch(const uint8_t* packed_bytes, const uint8_t* packed_bytes_end, uint
 				{
 					for (uint32_t i = 4; i < memberLen; ++i)
 					{
-						val = smolv_ReadVarint(packed_bytes, packed_bytes_end);
+						val = smolv_ReadVarint(memberStream, packed_bytes_end);
 						smolv_Write4(spirvCode, val);
 					}
 				}
@@ -1047,14 +1374,24 @@ void decrunch(const uint8_t* packed_bytes, const uint8_t* packed_bytes_end, uint
 
 		for (int i = 0; i < relativeCount && ioffs < instrLen; ++i, ++ioffs)
 		{
-			val = smolv_ReadVarint(packed_bytes, packed_bytes_end);
+// >>>>> SPIRVCRUNCHER Replace Start >>>>> RelativeOperand
+			val = smolv_ReadVarint(operandStream, packed_bytes_end);
 			val = smolv_ZigDecode(val);
 			smolv_Write4(spirvCode, prevResult - val);
+// >>>>> SPIRVCRUNCHER Replace End >>>>> RelativeOperand
 		}
 
+// >>>>> SPIRVCRUNCHER Option Start >>>>> GroupVarint
+		// rest of words as group varints
+		if (opInfo.varrest != 0 && !(wasSwizzle && instrLen <= 9))
+		{
+			for (; ioffs < instrLen; ++ioffs) smolv_Write4(spirvCode, smolv_ReadGroupVarint(literalStream, literalGroups));
+			continue;
+		}
+// >>>>> SPIRVCRUNCHER Option End >>>>> GroupVarint
 		if (wasSwizzle && instrLen <= 9)
 		{
-			uint32_t swizzle = *packed_bytes++;
+			uint32_t swizzle = *literalStream++;
 // >>>>> SPIRVCRUNCHER Block Start >>>>> wasSizzleInstrLen9_5
 			if (instrLen > 5) smolv_Write4(spirvCode, (swizzle >> 6) & 3);
 // >>>>> SPIRVCRUNCHER Block End >>>>> wasSizzleInstrLen9_5
@@ -1074,7 +1411,7 @@ void decrunch(const uint8_t* packed_bytes, const uint8_t* packed_bytes_end, uint
 			// read rest of words with variable encoding
 			for (; ioffs < instrLen; ++ioffs)
 			{
-				val = smolv_ReadVarint(packed_bytes, packed_bytes_end);
+				val = smolv_ReadVarint(literalStream, packed_bytes_end);
 				smolv_Write4(spirvCode, val);
 			}
 		}
@@ -1086,8 +1423,8 @@ void decrunch(const uint8_t* packed_bytes, const uint8_t* packed_bytes_end, uint
 			for (; ioffs < instrLen; ++ioffs)
 			{
 				// Shorter Read4
-				val = (packed_bytes[0]) | (packed_bytes[1] << 8) | (packed_bytes[2] << 16) | (packed_bytes[3] << 24);
-				packed_bytes += 4;
+				val = (literalStream[0]) | (literalStream[1] << 8) | (literalStream[2] << 16) | (literalStream[3] << 24);
+				literalStream += 4;
 				smolv_Write4(spirvCode, val);
 			}
 		}
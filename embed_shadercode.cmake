@@ -1,10 +1,232 @@
 # embed shadercode to main build
+#
+# Template is precompiled into a table of segments. SPIRVCRUNCHER markers are parsed here, so that
+# spirvcruncher only walks the segments, and unbalanced markers fail the build of the tool.
+cmake_policy(SET CMP0007 NEW)
 message(STATUS "INPUT=${INPUT}")
 file(READ "${INPUT}" FILE_CONTENTS)
 
-# Escape backslashes and quotes for C++ string literal
-string(REPLACE "\\" "\\\\" FILE_CONTENTS "${FILE_CONTENTS}")
-string(REPLACE "\"" "\\\"" FILE_CONTENTS "${FILE_CONTENTS}")
-string(REPLACE "\n" "\\n\"\n\"" FILE_CONTENTS "${FILE_CONTENTS}")
+# Protect list separators and brackets, then split to lines
+string(REPLACE ";" "<SC_SEMICOLON>" FILE_CONTENTS "${FILE_CONTENTS}")
+string(REPLACE "[" "<SC_BRACKET_OPEN>" FILE_CONTENTS "${FILE_CONTENTS}")
+string(REPLACE "]" "<SC_BRACKET_CLOSE>" FILE_CONTENTS "${FILE_CONTENTS}")
+string(REPLACE "\r" "" FILE_CONTENTS "${FILE_CONTENTS}")
+string(REPLACE "\n" ";" TEMPLATE_LINES "${FILE_CONTENTS}")
 
-file(WRITE "${OUTPUT}" "constexpr char shadertemplate[] = \"${FILE_CONTENTS}\";\n")
\ No newline at end of file
+# Last newline of the file doesn't start a new line
+list(LENGTH TEMPLATE_LINES LINE_COUNT)
+if(LINE_COUNT GREATER 0)
+    list(GET TEMPLATE_LINES -1 LAST_LINE)
+    if(LAST_LINE STREQUAL "")
+        list(REMOVE_AT TEMPLATE_LINES -1)
+    endif()
+endif()
+
+# Escape line for C++ string literal
+function(escape_line LINE OUT)
+    string(REPLACE "<SC_SEMICOLON>" ";" LINE "${LINE}")
+    string(REPLACE "<SC_BRACKET_OPEN>" "[" LINE "${LINE}")
+    string(REPLACE "<SC_BRACKET_CLOSE>" "]" LINE "${LINE}")
+    string(REPLACE "\\" "\\\\" LINE "${LINE}")
+    string(REPLACE "\"" "\\\"" LINE "${LINE}")
+    set(${OUT} "${LINE}" PARENT_SCOPE)
+endfunction()
+
+# Tag of the marker line is the text after the last ">>>>>"
+function(get_marker_tag LINE OUT)
+    string(FIND "${LINE}" ">>>>>" POS REVERSE)
+    math(EXPR POS "${POS} + 5")
+    string(SUBSTRING "${LINE}" ${POS} -1 TAG)
+    string(STRIP "${TAG}" TAG)
+    set(${OUT} "${TAG}" PARENT_SCOPE)
+endfunction()
+
+function(template_error LINE_NUMBER MESSAGE)
+    message(FATAL_ERROR "${INPUT}:${LINE_NUMBER}: ${MESSAGE}")
+endfunction()
+
+set(SEGMENTS "")
+set(TEXT "")
+
+# Write out pending text lines as one segment
+macro(flush_text)
+    if(NOT TEXT STREQUAL "")
+        string(APPEND SEGMENTS "\t{ TemplateSegmentKind::Text, \"\", -1, std::string_view(\n${TEXT}\t), { 0, 0, 0, 0 } },\n")
+        set(TEXT "")
+    endif()
+endmacro()
+
+macro(add_segment KIND TAG OP)
+    flush_text()
+    string(APPEND SEGMENTS "\t{ TemplateSegmentKind::${KIND}, \"${TAG}\", ${OP}, std::string_view(), { 0, 0, 0, 0 } },\n")
+endmacro()
+
+set(LINE_NUMBER 0)
+set(HEADER_DONE FALSE)
+set(IN_REMOVE FALSE)
+set(IN_BLOCK FALSE)
+set(IN_BLOCKINBLOCK FALSE)
+set(IN_SPV FALSE)
+set(IN_REMAP FALSE)
+set(IN_REPLACE FALSE)
+set(IN_OPTION FALSE)
+set(SPV_INDEX 0)
+
+foreach(LINE IN LISTS TEMPLATE_LINES)
+    math(EXPR LINE_NUMBER "${LINE_NUMBER} + 1")
+
+    # Header part is copied as is, until the shader data
+    if(NOT HEADER_DONE)
+        if(LINE MATCHES "SPIRVCRUNCHER Shaderblock")
+            add_segment(Shaderblock "" -1)
+            set(HEADER_DONE TRUE)
+        else()
+            escape_line("${LINE}" ESCAPED)
+            string(APPEND TEXT "\t\t\"${ESCAPED}\\n\"\n")
+        endif()
+        continue()
+    endif()
+
+    # Remove completely on build
+    if(LINE MATCHES "SPIRVCRUNCHER Remove on build start")
+        if(IN_REMOVE)
+            template_error(${LINE_NUMBER} "nested Remove on build start")
+        endif()
+        set(IN_REMOVE TRUE)
+        continue()
+    endif()
+    if(LINE MATCHES "SPIRVCRUNCHER Remove on build end")
+        if(NOT IN_REMOVE)
+            template_error(${LINE_NUMBER} "Remove on build end without start")
+        endif()
+        set(IN_REMOVE FALSE)
+        continue()
+    endif()
+    if(IN_REMOVE OR LINE MATCHES "SPIRVCRUNCHER skip on build")
+        continue()
+    endif()
+
+    if(LINE MATCHES "SPIRVCRUNCHER Remap Start")
+        if(IN_REMAP OR IN_BLOCK OR IN_SPV)
+            template_error(${LINE_NUMBER} "Remap Start inside another segment")
+        endif()
+        set(IN_REMAP TRUE)
+        add_segment(RemapStart "" -1)
+    elseif(LINE MATCHES "SPIRVCRUNCHER Remap End")
+        if(NOT IN_REMAP OR IN_BLOCK)
+            template_error(${LINE_NUMBER} "unbalanced Remap End")
+        endif()
+        set(IN_REMAP FALSE)
+        add_segment(RemapEnd "" -1)
+    elseif(LINE MATCHES "SPIRVCRUNCHER Replace Start")
+        if(IN_REPLACE OR IN_SPV)
+            template_error(${LINE_NUMBER} "Replace Start inside another segment")
+        endif()
+        get_marker_tag("${LINE}" TAG)
+        if(TAG STREQUAL "")
+            template_error(${LINE_NUMBER} "Replace Start without a tag")
+        endif()
+        set(IN_REPLACE TRUE)
+        add_segment(ReplaceStart "${TAG}" -1)
+    elseif(LINE MATCHES "SPIRVCRUNCHER Replace End")
+        if(NOT IN_REPLACE)
+            template_error(${LINE_NUMBER} "Replace End without start")
+        endif()
+        set(IN_REPLACE FALSE)
+        add_segment(ReplaceEnd "" -1)
+    elseif(LINE MATCHES "SPIRVCRUNCHER Option Start")
+        if(IN_OPTION OR IN_SPV)
+            template_error(${LINE_NUMBER} "Option Start inside another segment")
+        endif()
+        get_marker_tag("${LINE}" TAG)
+        if(TAG STREQUAL "")
+            template_error(${LINE_NUMBER} "Option Start without a tag")
+        endif()
+        set(IN_OPTION TRUE)
+        add_segment(OptionStart "${TAG}" -1)
+    elseif(LINE MATCHES "SPIRVCRUNCHER Option End")
+        if(NOT IN_OPTION)
+            template_error(${LINE_NUMBER} "Option End without start")
+        endif()
+        set(IN_OPTION FALSE)
+        add_segment(OptionEnd "" -1)
+    elseif(LINE MATCHES "SPIRVCRUNCHER Block Start")
+        if(IN_BLOCK OR IN_SPV)
+            template_error(${LINE_NUMBER} "Block Start inside another segment")
+        endif()
+        get_marker_tag("${LINE}" TAG)
+        if(TAG STREQUAL "")
+            template_error(${LINE_NUMBER} "Block Start without a tag")
+        endif()
+        set(IN_BLOCK TRUE)
+        add_segment(BlockStart "${TAG}" -1)
+    elseif(LINE MATCHES "SPIRVCRUNCHER Block End")
+        if(NOT IN_BLOCK OR IN_BLOCKINBLOCK)
+            template_error(${LINE_NUMBER} "unbalanced Block End")
+        endif()
+        set(IN_BLOCK FALSE)
+        add_segment(BlockEnd "" -1)
+    elseif(LINE MATCHES "SPIRVCRUNCHER BlockInBlock Start")
+        if(NOT IN_BLOCK OR IN_BLOCKINBLOCK)
+            template_error(${LINE_NUMBER} "BlockInBlock Start outside of a Block")
+        endif()
+        get_marker_tag("${LINE}" TAG)
+        if(TAG STREQUAL "")
+            template_error(${LINE_NUMBER} "BlockInBlock Start without a tag")
+        endif()
+        set(IN_BLOCKINBLOCK TRUE)
+        add_segment(BlockInBlockStart "${TAG}" -1)
+    elseif(LINE MATCHES "SPIRVCRUNCHER BlockInBlock End")
+        if(NOT IN_BLOCKINBLOCK)
+            template_error(${LINE_NUMBER} "unbalanced BlockInBlock End")
+        endif()
+        set(IN_BLOCKINBLOCK FALSE)
+        add_segment(BlockInBlockEnd "" -1)
+    elseif(LINE MATCHES "SPIRVCRUNCHER Spv Start")
+        if(IN_SPV OR IN_BLOCK)
+            template_error(${LINE_NUMBER} "Spv Start inside another segment")
+        endif()
+        set(IN_SPV TRUE)
+    elseif(LINE MATCHES "SPIRVCRUNCHER Spv End")
+        if(NOT IN_SPV)
+            template_error(${LINE_NUMBER} "Spv End without start")
+        endif()
+        set(IN_SPV FALSE)
+    elseif(LINE MATCHES "SPIRVCRUNCHER")
+        template_error(${LINE_NUMBER} "unknown SPIRVCRUNCHER marker")
+    elseif(IN_SPV)
+        # One segment per op line, with the op data fields for packed emission
+        flush_text()
+        if(NOT LINE MATCHES "{ *([0-9]+), *([0-9]+), *([0-9]+), *([0-9]+) *}")
+            template_error(${LINE_NUMBER} "Spv line without op data")
+        endif()
+        set(OPDATA "{ ${CMAKE_MATCH_1}, ${CMAKE_MATCH_2}, ${CMAKE_MATCH_3}, ${CMAKE_MATCH_4} }")
+        escape_line("${LINE}" ESCAPED)
+        string(APPEND SEGMENTS "\t{ TemplateSegmentKind::Spv, \"\", ${SPV_INDEX}, std::string_view(\"${ESCAPED}\\n\"), ${OPDATA} },\n")
+        math(EXPR SPV_INDEX "${SPV_INDEX} + 1")
+    else()
+        escape_line("${LINE}" ESCAPED)
+        string(APPEND TEXT "\t\t\"${ESCAPED}\\n\"\n")
+    endif()
+endforeach()
+
+if(NOT HEADER_DONE)
+    template_error(${LINE_NUMBER} "missing Shaderblock marker")
+endif()
+if(IN_REMOVE OR IN_BLOCK OR IN_BLOCKINBLOCK OR IN_SPV OR IN_REMAP OR IN_REPLACE OR IN_OPTION)
+    template_error(${LINE_NUMBER} "unterminated segment at the end of template")
+endif()
+flush_text()
+
+file(WRITE "${OUTPUT}" "// Generated by embed_shadercode.cmake from spirvcruncher_template.h\n\n"
+    "#pragma once\n\n"
+    "#include <string_view>\n\n"
+    "enum class TemplateSegmentKind { Text, Shaderblock, BlockStart, BlockEnd, BlockInBlockStart, BlockInBlockEnd, Spv, RemapStart, RemapEnd, ReplaceStart, ReplaceEnd, OptionStart, OptionEnd };\n\n"
+    "struct TemplateSegment\n{\n"
+    "\tTemplateSegmentKind kind;\n"
+    "\tconst char* tag;\t\t// Block, BlockInBlock, Replace and Option tag\n"
+    "\tint op;\t\t\t\t// Spv op index\n"
+    "\tstd::string_view text;\n"
+    "\tunsigned char opData[4];\t// Spv hasResult, hasType, deltaFromResult, varrest\n"
+    "};\n\n"
+    "constexpr TemplateSegment shadertemplateSegments[] =\n{\n${SEGMENTS}};\n")
@@ -0,0 +1,1185 @@
+﻿// crunchencoder.cpp - smol-v compatible encoder with spirvcruncher extensions
+// 
+// (c) 2025 Ossi Luoto
+//
+// Encoder follows smol-v (https://github.com/aras-p/smol-v) encoding format, see licence at the
+// end of the file. The stream is the one decoded by the decrunch-function in the template.
+
+#include "crunchencoder.h"
+#include "generated_shadertemplate.h"
+
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <queue>
+
+using namespace std;
+using namespace smolv;
+
+// --------------------------------------------------------------------------------------------
+// Metadata about known SPIR-V operations, taken from the Spv rows of kSpirvOpData in the template
+// so that the encoder and the emitted decoder share one table
+
+static constexpr int countTemplateOps()
+{
+	int count = 0;
+	for (const TemplateSegment& segment : shadertemplateSegments)
+	{
+		if (segment.kind == TemplateSegmentKind::Spv) count++;
+	}
+	return count;
+}
+
+static constexpr int kKnownOpsCount = countTemplateOps();
+
+struct KnownOpsTable
+{
+	CrunchOpData ops[kKnownOpsCount];
+};
+
+static constexpr KnownOpsTable buildKnownOpsTable()
+{
+	KnownOpsTable table = {};
+	for (const TemplateSegment& segment : shadertemplateSegments)
+	{
+		if (segment.kind != TemplateSegmentKind::Spv) continue;
+		table.ops[segment.op] = { segment.opData[0], segment.opData[1], segment.opData[2], segment.opData[3] };
+	}
+	return table;
+}
+
+static constexpr KnownOpsTable kSpirvOpData = buildKnownOpsTable();
+
+// Extended ops, used only with the dense op table
+struct ExtendedOpData
+{
+	uint16_t op;
+	CrunchOpData data;
+	const char* name;
+};
+
+static const ExtendedOpData kSpirvExtendedOpData[] =
+{
+	{4416, {0, 0, 0, 0}, "TerminateInvocation"},
+	{4421, {1, 1, 1, 0}, "SubgroupBallotKHR"},
+	{4422, {1, 1, 1, 0}, "SubgroupFirstInvocationKHR"},
+	{4428, {1, 1, 1, 0}, "SubgroupAllKHR"},
+	{4429, {1, 1, 1, 0}, "SubgroupAnyKHR"},
+	{4430, {1, 1, 1, 0}, "SubgroupAllEqualKHR"},
+	{4432, {1, 1, 2, 0}, "SubgroupReadInvocationKHR"},
+	{4445, {0, 0, 11, 0}, "TraceRayKHR"},
+	{4446, {0, 0, 2, 0}, "ExecuteCallableKHR"},
+	{4447, {1, 1, 1, 0}, "ConvertUToAccelerationStructureKHR"},
+	{4448, {0, 0, 0, 0}, "IgnoreIntersectionKHR"},
+	{4449, {0, 0, 0, 0}, "TerminateRayKHR"},
+	{4472, {1, 0, 0, 0}, "TypeRayQueryKHR"},
+	{4473, {0, 0, 8, 0}, "RayQueryInitializeKHR"},
+	{4474, {0, 0, 1, 0}, "RayQueryTerminateKHR"},
+	{4475, {0, 0, 2, 0}, "RayQueryGenerateIntersectionKHR"},
+	{4476, {0, 0, 1, 0}, "RayQueryConfirmIntersectionKHR"},
+	{4477, {1, 1, 1, 0}, "RayQueryProceedKHR"},
+	{4479, {1, 1, 2, 0}, "RayQueryGetIntersectionTypeKHR"},
+	{5294, {0, 0, 4, 0}, "EmitMeshTasksEXT"},
+	{5295, {0, 0, 2, 0}, "SetMeshOutputsEXT"},
+	{5334, {1, 1, 2, 0}, "ReportIntersectionKHR"},
+	{5341, {1, 0, 0, 0}, "TypeAccelerationStructureKHR"},
+	{5380, {0, 0, 0, 0}, "DemoteToHelperInvocation"},
+	{5381, {1, 1, 0, 0}, "IsHelperInvocationEXT"},
+	{6016, {1, 1, 1, 0}, "RayQueryGetRayTMinKHR"},
+	{6017, {1, 1, 1, 0}, "RayQueryGetRayFlagsKHR"},
+	{6018, {1, 1, 2, 0}, "RayQueryGetIntersectionTKHR"},
+	{6019, {1, 1, 2, 0}, "RayQueryGetIntersectionInstanceCustomIndexKHR"},
+	{6020, {1, 1, 2, 0}, "RayQueryGetIntersectionInstanceIdKHR"},
+	{6021, {1, 1, 2, 0}, "RayQueryGetIntersectionInstanceShaderBindingTableRecordOffsetKHR"},
+	{6022, {1, 1, 2, 0}, "RayQueryGetIntersectionGeometryIndexKHR"},
+	{6023, {1, 1, 2, 0}, "RayQueryGetIntersectionPrimitiveIndexKHR"},
+	{6024, {1, 1, 2, 0}, "RayQueryGetIntersectionBarycentricsKHR"},
+	{6025, {1, 1, 2, 0}, "RayQueryGetIntersectionFrontFaceKHR"},
+	{6026, {1, 1, 1, 0}, "RayQueryGetIntersectionCandidateAABBOpaqueKHR"},
+	{6027, {1, 1, 2, 0}, "RayQueryGetIntersectionObjectRayDirectionKHR"},
+	{6028, {1, 1, 2, 0}, "RayQueryGetIntersectionObjectRayOriginKHR"},
+	{6029, {1, 1, 1, 0}, "RayQueryGetWorldRayDirectionKHR"},
+	{6030, {1, 1, 1, 0}, "RayQueryGetWorldRayOriginKHR"},
+	{6031, {1, 1, 2, 0}, "RayQueryGetIntersectionObjectToWorldKHR"},
+	{6032, {1, 1, 2, 0}, "RayQueryGetIntersectionWorldToObjectKHR"},
+};
+
+static const ExtendedOpData* findExtendedOp(uint32_t op)
+{
+	for (const auto& extended : kSpirvExtendedOpData)
+	{
+		if (extended.op == op) return &extended;
+	}
+	return nullptr;
+}
+
+CrunchOpData getCrunchOpData(uint32_t op, bool bExtendedOps)
+{
+	if (op < (uint32_t)kKnownOpsCount) return kSpirvOpData.ops[op];
+
+	const ExtendedOpData* extended = bExtendedOps ? findExtendedOp(op) : nullptr;
+	return extended ? extended->data : CrunchOpData{ 0, 0, 0, 0 };
+}
+
+const char* getExtendedOpName(uint32_t op)
+{
+	const ExtendedOpData* extended = findExtendedOp(op);
+	return extended ? extended->name : nullptr;
+}
+
+enum
+{
+	kOpSourceContinued = 2,
+	kOpSource = 3,
+	kOpSourceExtension = 4,
+	kOpName = 5,
+	kOpMemberName = 6,
+	kOpString = 7,
+	kOpLine = 8,
+	kOpExtension = 10,
+	kOpExtInstImport = 11,
+	kOpVectorShuffleCompact = 13, // not in SPIR-V, added for SMOL-V!
+	kOpAccessChainCompact = 58, // not in SPIR-V, added for spirvcruncher
+	kOpCompositeExtractCompact = 76, // not in SPIR-V, added for spirvcruncher
+	kOpCompositeConstructCompact = 85, // not in SPIR-V, added for spirvcruncher
+	kOpEntryPoint = 15,
+	kOpDecorate = 71,
+	kOpMemberDecorate = 72,
+	kOpVectorShuffle = 79,
+	kOpCompositeConstruct = 80,
+	kOpCompositeExtract = 81,
+	kOpLoad = 61,
+	kOpAccessChain = 65,
+	kOpStore = 62,
+	kOpVariable = 59,
+	kOpTypePointer = 32,
+	kOpConstant = 43,
+	kOpFNegate = 127,
+	kOpFAdd = 129,
+	kOpFMul = 133,
+	kOpLabel = 248,
+	kOpNoLine = 317,
+	kOpModuleProcessed = 330,
+};
+
+static bool opDebugInfo(uint32_t op)
+{
+	return op == kOpSourceContinued || op == kOpSource || op == kOpSourceExtension || op == kOpName ||
+		op == kOpMemberName || op == kOpString || op == kOpLine || op == kOpNoLine || op == kOpModuleProcessed;
+}
+
+static int decorationExtraOps(uint32_t dec)
+{
+	if (dec == 0 || (dec >= 2 && dec <= 5)) // RelaxedPrecision, Block..ColMajor
+		return 0;
+	if (dec >= 29 && dec <= 37) // Stream..XfbStride
+		return 1;
+	return -1; // unknown, encode length
+}
+
+// --------------------------------------------------------------------------------------------
+
+static void write4(ByteArray& out, uint32_t v)
+{
+	out.push_back(v & 0xFF);
+	out.push_back((v >> 8) & 0xFF);
+	out.push_back((v >> 16) & 0xFF);
+	out.push_back(v >> 24);
+}
+
+static void writeVarint(ByteArray& out, uint32_t v)
+{
+	while (v > 127)
+	{
+		out.push_back((v & 127) | 128);
+		v >>= 7;
+	}
+	out.push_back(v & 127);
+}
+
+// Values of one field in groups of four. A group is the control byte and the four values together,
+// at the place of the first value in its stream, so that decrunch decodes all four at once. Groups
+// are collected aside and spliced in when the payload is done, the last one of a field padded with
+// zero values.
+struct GroupVarintBlock {
+	ByteArray* stream;
+	size_t offset;
+	ByteArray bytes;
+};
+
+struct GroupVarintWriter {
+	vector<GroupVarintBlock>* blocks = nullptr;
+	size_t current = 0;
+	uint32_t count = 4;
+
+	void write(ByteArray& out, uint32_t v)
+	{
+		if (count == 4)
+		{
+			current = blocks->size();
+			blocks->push_back({ &out, out.size(), ByteArray(1, 0) });
+			count = 0;
+		}
+		ByteArray& bytes = (*blocks)[current].bytes;
+		const uint32_t size = v < (1u << 8) ? 1 : v < (1u << 16) ? 2 : v < (1u << 24) ? 3 : 4;
+		bytes[0] |= uint8_t((size - 1) << (count * 2));
+		for (uint32_t b = 0; b < size; ++b) bytes.push_back(uint8_t(v >> (b * 8)));
+		count++;
+	}
+
+	void finish()
+	{
+		while (count < 4) write(*(*blocks)[current].stream, 0);
+	}
+};
+
+// Blocks are in the order they were started, which is also the offset order within each stream
+static void spliceGroupVarints(const vector<GroupVarintBlock>& blocks)
+{
+	vector<ByteArray*> streams;
+	for (const auto& block : blocks)
+	{
+		if (find(streams.begin(), streams.end(), block.stream) == streams.end()) streams.push_back(block.stream);
+	}
+
+	for (ByteArray* stream : streams)
+	{
+		ByteArray spliced;
+		size_t from = 0;
+		for (const auto& block : blocks)
+		{
+			if (block.stream != stream) continue;
+			spliced.insert(spliced.end(), stream->begin() + from, stream->begin() + block.offset);
+			spliced.insert(spliced.end(), block.bytes.begin(), block.bytes.end());
+			from = block.offset;
+		}
+		spliced.insert(spliced.end(), stream->begin() + from, stream->end());
+		*stream = std::move(spliced);
+	}
+}
+
+static uint32_t zigEncode(int32_t i)
+{
+	return (uint32_t(i) << 1) ^ (i >> 31);
+}
+
+static size_t varintSize(uint32_t v)
+{
+	size_t size = 1;
+	for (; v > 127; v >>= 7) size++;
+	return size;
+}
+
+// Sign lowest, then the exponent as zigzag delta from that of 1.0 within 8 bits, then the mantissa
+// bits reversed, so that floats with short mantissas (0.5, 1.0, 10.0, -2.0) become small varints
+static uint32_t floatTransform(uint32_t v)
+{
+	uint32_t mantissa = 0;
+	for (int b = 0; b < 23; ++b) mantissa |= ((v >> b) & 1) << (22 - b);
+	int8_t exponent = int8_t(((v >> 23) & 0xFF) - 127);
+	uint32_t zig = uint8_t((exponent << 1) ^ (exponent >> 7));
+	return (mantissa << 9) | (zig << 1) | (v >> 31);
+}
+
+enum ConstantForm
+{
+	kConstantInt = 0,		// zigzag varint
+	kConstantFloat = 1,		// floatTransform varint
+	kConstantRaw = 2,
+};
+
+// Smallest form for all the literal words of an OpConstant, ints first on ties
+static uint32_t getConstantForm(const uint32_t* literals, size_t count)
+{
+	size_t intSize = 0;
+	size_t floatSize = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		intSize += varintSize(zigEncode(int32_t(literals[i])));
+		floatSize += varintSize(floatTransform(literals[i]));
+	}
+	if (intSize <= floatSize && intSize <= count * 4) return kConstantInt;
+	return floatSize <= count * 4 ? kConstantFloat : kConstantRaw;
+}
+
+// Matching smolv_DecodeLen in the template
+static uint32_t encodeLen(uint32_t op, uint32_t len)
+{
+	len--;
+	if (op == kOpVectorShuffle)			len -= 4;
+	if (op == kOpVectorShuffleCompact)	len -= 4;
+	if (op == kOpDecorate)				len -= 2;
+	if (op == kOpLoad)					len -= 3;
+	if (op == kOpAccessChain)			len -= 3;
+	return len;
+}
+
+// Shuffling bits of length + opcode to be more compact in varint encoding in typical cases:
+// 0x LLLL OOOO is how SPIR-V encodes it (L=length, O=op), we shuffle into:
+// 0x LLLO OOLO, so that common case (op<16, len<8) is encoded into one byte.
+
+// With fixed length ops, the variable length op codes are split to the low nibbles below
+// variableNibbles and the bits above, and a fixed length op is the nibble and the bits above only.
+
+static void writeLengthOp(ByteArray& out, uint32_t len, uint32_t op, const OpRemapTable& remapTable)
+{
+	len = encodeLen(op, len);
+	op = remapTable.remap((uint16_t)op);
+	if (remapTable.hasFixedLengths())
+	{
+		const uint32_t nibbles = remapTable.variableNibbles;
+		const uint32_t variableOps = (uint32_t)remapTable.variableOpCount();
+		if (op >= variableOps)
+		{
+			const uint32_t index = op - variableOps;
+			writeVarint(out, (nibbles + index % (16 - nibbles)) | ((index / (16 - nibbles)) << 4));
+			return;
+		}
+		op = (op % nibbles) | ((op / nibbles) << 4);
+	}
+	uint32_t oplen = ((len >> 4) << 20) | ((op >> 4) << 8) | ((len & 0xF) << 4) | (op & 0xF);
+	writeVarint(out, oplen);
+}
+
+void writeMacroReference(ByteArray& out, uint32_t index, const OpRemapTable& remapTable)
+{
+	writeLengthOp(out, 2, kOpMacro, remapTable);
+	writeVarint(out, index);
+}
+
+// --------------------------------------------------------------------------------------------
+
+OpRemapTable getSmolvRemapTable()
+{
+	// _SMOLV_SWAP_OP list of the template, shares are the smol-v comments
+	OpRemapTable table;
+	table.swaps = {
+		{ kOpDecorate, 0, 24.0 }, { kOpLoad, 1, 17.0 }, { kOpStore, 2, 9.0 }, { kOpAccessChain, 3, 7.2 },
+		{ kOpVectorShuffle, 4, 5.0 }, { kOpMemberDecorate, 7, 4.0 }, { kOpLabel, 8, 0.9 }, { kOpVariable, 9, 3.9 },
+		{ kOpFMul, 10, 3.9 }, { kOpFAdd, 11, 2.5 }, { kOpTypePointer, 14, 2.2 }, { kOpFNegate, 15, 1.1 },
+	};
+	return table;
+}
+
+void OpRemapTable::setDenseOps(const vector<uint16_t>& ops)
+{
+	denseOps = ops;
+	denseCodes.clear();
+	for (size_t i = 0; i < denseOps.size(); ++i)
+	{
+		denseCodes[denseOps[i]] = (uint16_t)i;
+	}
+}
+
+uint16_t OpRemapTable::remap(uint16_t op) const
+{
+	if (isDense())
+	{
+		auto code = denseCodes.find(op);
+		return code != denseCodes.end() ? code->second : kInvalidCode;
+	}
+
+	for (const auto& swap : swaps)
+	{
+		if (op == swap.op) return swap.code;
+		if (op == swap.code) return swap.op;
+	}
+	return op;
+}
+
+uint32_t OpRemapTable::fixedLength(uint16_t op) const
+{
+	if (!hasFixedLengths()) return 0;
+
+	const uint16_t code = remap(op);
+	if (code == kInvalidCode || code < variableOpCount()) return 0;
+	return fixedLengths[code - variableOpCount()];
+}
+
+OpRemapTable buildOpRemapTable(const DecodeAnalysis& analysis)
+{
+	OpRemapTable table;
+
+	// Collect op histogram from the analysis
+	struct OpCount { uint16_t op; uint64_t count; };
+	vector<OpCount> ops;
+	uint64_t totalCount = 0;
+
+	for (const auto& spvOp : analysis.SpvOps)
+	{
+		char* end = nullptr;
+		unsigned long op = strtoul(spvOp.entry.c_str(), &end, 10);
+		if (end == spvOp.entry.c_str() || op > 0xFFFF) continue;
+
+		totalCount += spvOp.count;
+
+		// VectorShuffleCompact is the pseudo op used by smol-v, keep it where it is
+		if (op == kOpVectorShuffleCompact) continue;
+		ops.push_back({ (uint16_t)op, (uint64_t)spvOp.count });
+	}
+
+	if (ops.empty()) return table;
+
+	sort(ops.begin(), ops.end(), [](const OpCount& a, const OpCount& b) {
+		return a.count != b.count ? a.count > b.count : a.op < b.op;
+	});
+
+	// Hottest ops get the single nibble codes, ones already < 16 stay in their place
+	const size_t kNibbleCodes = 15; // 0..15, except VectorShuffleCompact
+	if (ops.size() > kNibbleCodes) ops.resize(kNibbleCodes);
+
+	bool codeTaken[16] = {};
+	codeTaken[kOpVectorShuffleCompact] = true;
+	for (const auto& op : ops)
+	{
+		if (op.op < 16) codeTaken[op.op] = true;
+	}
+
+	uint16_t nextCode = 0;
+	for (const auto& op : ops)
+	{
+		if (op.op < 16) continue;
+
+		while (codeTaken[nextCode]) nextCode++;
+		codeTaken[nextCode] = true;
+
+		table.swaps.push_back({ op.op, nextCode, 100.0 * (double)op.count / (double)totalCount });
+	}
+
+	return table;
+}
+
+OpRemapTable buildDenseOpTable(const DecodeAnalysis& analysis)
+{
+	OpRemapTable table;
+
+	struct OpCount { uint16_t op; uint64_t count; };
+	vector<OpCount> ops;
+	bool bHasShuffle = false;
+
+	for (const auto& spvOp : analysis.SpvOps)
+	{
+		char* end = nullptr;
+		unsigned long op = strtoul(spvOp.entry.c_str(), &end, 10);
+		if (end == spvOp.entry.c_str() || op > 0xFFFF) continue;
+
+		if (op == kOpVectorShuffle || op == kOpVectorShuffleCompact) bHasShuffle = true;
+		ops.push_back({ (uint16_t)op, (uint64_t)spvOp.count });
+	}
+
+	// Encoder picks between VectorShuffle and VectorShuffleCompact per instruction, need both
+	if (bHasShuffle)
+	{
+		for (uint16_t shuffleOp : { (uint16_t)kOpVectorShuffle, (uint16_t)kOpVectorShuffleCompact })
+		{
+			if (none_of(ops.begin(), ops.end(), [&](const OpCount& o) { return o.op == shuffleOp; }))
+				ops.push_back({ shuffleOp, 0 });
+		}
+	}
+
+	sort(ops.begin(), ops.end(), [](const OpCount& a, const OpCount& b) {
+		return a.count != b.count ? a.count > b.count : a.op < b.op;
+	});
+
+	vector<uint16_t> denseOps;
+	for (const auto& op : ops) denseOps.push_back(op.op);
+	table.setDenseOps(denseOps);
+
+	return table;
+}
+
+// Compact forms, checked the same way when rewriting and when encoding:
+// - CompositeExtract of one index below 4, composite delta from the result and the index in one varint
+// - CompositeConstruct of 2-4 components that are 1-4 results back, the deltas in one byte
+// - AccessChain of one index, index delta from the previous compact chain and a bit for the same base
+//   in one varint, followed by the base only when it changes
+static bool fitsCompactOp(uint32_t compactOp, const uint32_t* words, size_t instrLen, uint32_t prevChainIndex)
+{
+	switch (compactOp)
+	{
+	case kOpCompositeExtractCompact:
+		return instrLen == 5 && words[4] < 4 && zigEncode(words[2] - words[3]) < (1u << 30);
+	case kOpCompositeConstructCompact:
+		if (instrLen < 5 || instrLen > 7) return false;
+		for (size_t i = 3; i < instrLen; ++i)
+		{
+			if (words[2] - words[i] - 1 > 3) return false;
+		}
+		return true;
+	case kOpAccessChainCompact:
+		return instrLen == 5 && zigEncode(words[4] - prevChainIndex) < (1u << 31);
+	default:
+		return false;
+	}
+}
+
+static uint32_t getCompactOp(uint32_t op)
+{
+	if (op == kOpCompositeExtract) return kOpCompositeExtractCompact;
+	if (op == kOpCompositeConstruct) return kOpCompositeConstructCompact;
+	if (op == kOpAccessChain) return kOpAccessChainCompact;
+	return 0;
+}
+
+size_t rewriteCompactOps(ByteArray& payload)
+{
+	const size_t wordCount = payload.size() / 4;
+	uint32_t* words = (uint32_t*)payload.data();
+	uint32_t prevChainIndex = 0;
+	size_t count = 0;
+
+	for (size_t offs = 5; offs < wordCount;)
+	{
+		uint32_t* instruction = words + offs;
+		const size_t instrLen = instruction[0] >> 16;
+		if (instrLen < 1 || offs + instrLen > wordCount) break;
+		offs += instrLen;
+
+		const uint32_t compactOp = getCompactOp(instruction[0] & 0xFFFF);
+		if (!fitsCompactOp(compactOp, instruction, instrLen, prevChainIndex)) continue;
+
+		instruction[0] = (uint32_t(instrLen) << 16) | compactOp;
+		if (compactOp == kOpAccessChainCompact) prevChainIndex = instruction[4];
+		count++;
+	}
+	return count;
+}
+
+// Word offset of the literal string in the ops of the string table, 0 for other ops
+static size_t getStringOffset(uint32_t op)
+{
+	switch (op)
+	{
+	case kOpSourceExtension:
+	case kOpExtension:
+	case kOpModuleProcessed:
+		return 1;
+	case kOpName:
+	case kOpString:
+	case kOpExtInstImport:
+		return 2;
+	case kOpMemberName:
+	case kOpEntryPoint:
+		return 3;
+	default:
+		return 0;
+	}
+}
+
+// Words of the nul terminated string at offs, 0 if it runs past the instruction
+static size_t getStringWordCount(const uint32_t* words, size_t offs, size_t instrLen)
+{
+	for (size_t i = offs; i < instrLen; ++i)
+	{
+		if ((words[i] & 0xFF000000) == 0) return i + 1 - offs;
+	}
+	return 0;
+}
+
+static string getStringKey(const uint32_t* words, size_t count)
+{
+	return string((const char*)words, count * 4);
+}
+
+StringTable buildStringTable(const vector<const ByteArray*>& modules, uint32_t flags)
+{
+	struct StringCount {
+		string key;
+		size_t count;
+	};
+	vector<StringCount> strings;
+	unordered_map<string, size_t> found;
+
+	for (const ByteArray* module : modules)
+	{
+		const size_t wordCount = module->size() / 4;
+		if (wordCount < 5) continue;
+
+		const ByteArray& spirv = *module;
+		vector<uint32_t> spirvWords(wordCount);
+		for (size_t i = 0; i < wordCount; ++i)
+		{
+			spirvWords[i] = spirv[i * 4] | (spirv[i * 4 + 1] << 8) | (spirv[i * 4 + 2] << 16) | ((uint32_t)spirv[i * 4 + 3] << 24);
+		}
+
+		for (size_t offs = 5; offs < wordCount;)
+		{
+			const uint32_t* words = &spirvWords[offs];
+			const size_t instrLen = words[0] >> 16;
+			const uint32_t op = words[0] & 0xFFFF;
+			if (instrLen < 1 || offs + instrLen > wordCount) break;
+			offs += instrLen;
+
+			if ((flags & kEncodeFlagStripDebugInfo) && opDebugInfo(op)) continue;
+			const size_t stringOffs = getStringOffset(op);
+			const size_t stringWords = stringOffs ? getStringWordCount(words, stringOffs, instrLen) : 0;
+			if (!stringWords) continue;
+
+			string key = getStringKey(words + stringOffs, stringWords);
+			auto it = found.find(key);
+			if (it == found.end())
+			{
+				found.emplace(key, strings.size());
+				strings.push_back({ key, 1 });
+			}
+			else strings[it->second].count++;
+		}
+	}
+
+	// Most used first for the smallest indices, ties in the order of first use
+	stable_sort(strings.begin(), strings.end(), [](const StringCount& a, const StringCount& b) {
+		return a.count > b.count;
+	});
+
+	StringTable table;
+	for (const auto& entry : strings)
+	{
+		const size_t stringWords = entry.key.size() / 4;
+		table.indices.emplace(entry.key, (uint32_t)table.indices.size());
+		table.words.push_back((uint32_t)stringWords);
+		const size_t start = table.words.size();
+		table.words.resize(start + stringWords);
+		memcpy(&table.words[start], entry.key.data(), entry.key.size());
+	}
+	return table;
+}
+
+// Typical <=4 component swizzle shape of VectorShuffle is written as single byte
+static uint32_t getWriteOp(const uint32_t* words, size_t instrLen, uint32_t& swizzle)
+{
+	const uint32_t op = words[0] & 0xFFFF;
+	swizzle = 0;
+	if (op != kOpVectorShuffle || instrLen > 9) return op;
+
+	for (size_t i = 0; i + 5 < instrLen; ++i)
+	{
+		uint32_t v = words[5 + i];
+		if (v > 3) return op;
+		swizzle |= v << (3 - i) * 2;
+	}
+	return kOpVectorShuffleCompact;
+}
+
+OpRemapTable buildFixedLengthOpTable(const DecodeAnalysis& analysis, const vector<const ByteArray*>& modules, uint32_t flags)
+{
+	OpRemapTable table = buildDenseOpTable(analysis);
+
+	// Instruction count and length of each op, length 0 for ops seen with different lengths
+	struct OpLength { uint64_t count; uint32_t length; };
+	unordered_map<uint16_t, OpLength> lengths;
+
+	for (const ByteArray* module : modules)
+	{
+		const size_t wordCount = module->size() / 4;
+		if (wordCount < 5) continue;
+
+		const ByteArray& spirv = *module;
+		vector<uint32_t> spirvWords(wordCount);
+		for (size_t i = 0; i < wordCount; ++i)
+		{
+			spirvWords[i] = spirv[i * 4] | (spirv[i * 4 + 1] << 8) | (spirv[i * 4 + 2] << 16) | ((uint32_t)spirv[i * 4 + 3] << 24);
+		}
+
+		for (size_t offs = 5; offs < wordCount;)
+		{
+			const uint32_t* words = &spirvWords[offs];
+			const size_t instrLen = words[0] >> 16;
+			if (instrLen < 1 || offs + instrLen > wordCount) break;
+			offs += instrLen;
+
+			if ((flags & kEncodeFlagStripDebugInfo) && opDebugInfo(words[0] & 0xFFFF)) continue;
+			uint32_t swizzle;
+			auto it = lengths.emplace((uint16_t)getWriteOp(words, instrLen, swizzle), OpLength{ 0, (uint32_t)instrLen }).first;
+			it->second.count++;
+			if (it->second.length != instrLen) it->second.length = 0;
+		}
+	}
+
+	// Fixed length ops last, both parts keep the frequency order
+	vector<uint16_t> variableOps;
+	vector<uint16_t> fixedOps;
+	for (uint16_t op : table.denseOps)
+	{
+		auto it = lengths.find(op);
+		const bool bFixed = it != lengths.end() && it->second.length != 0 && it->second.length <= 255;
+		(bFixed ? fixedOps : variableOps).push_back(op);
+	}
+	if (fixedOps.empty()) return table;
+
+	// Variable length op is one byte when its code is below the nibble count (length below 8 as
+	// before), a fixed length op when its index is below 8 per fixed length nibble
+	uint64_t bestBytes = UINT64_MAX;
+	const uint32_t firstNibbles = variableOps.empty() ? 0 : 1;
+	for (uint32_t nibbles = firstNibbles; nibbles < 16; ++nibbles)
+	{
+		uint64_t bytes = 0;
+		for (size_t i = 0; i < variableOps.size(); ++i)
+		{
+			auto it = lengths.find(variableOps[i]);
+			if (it != lengths.end()) bytes += it->second.count * (i < nibbles ? 1 : 2);
+		}
+		for (size_t i = 0; i < fixedOps.size(); ++i)
+		{
+			bytes += lengths[fixedOps[i]].count * (i < (16 - nibbles) * 8 ? 1 : 2);
+		}
+		if (bytes <= bestBytes)
+		{
+			bestBytes = bytes;
+			table.variableNibbles = nibbles;
+		}
+	}
+
+	vector<uint16_t> denseOps = variableOps;
+	denseOps.insert(denseOps.end(), fixedOps.begin(), fixedOps.end());
+	table.setDenseOps(denseOps);
+	for (uint16_t op : fixedOps) table.fixedLengths.push_back((uint8_t)lengths[op].length);
+
+	return table;
+}
+
+// Huffman code lengths of the symbols, at most kMaxHuffmanBits. Counts are halved until the
+// longest code fits, ones keep every symbol in the tree.
+static vector<uint32_t> getHuffmanLengths(vector<uint64_t> counts)
+{
+	const size_t symbolCount = counts.size();
+	if (symbolCount == 1) return { 1 };
+
+	for (;;)
+	{
+		typedef pair<uint64_t, size_t> Node;
+		priority_queue<Node, vector<Node>, greater<Node>> heap;
+		vector<size_t> parent(symbolCount * 2 - 1, 0);
+		for (size_t i = 0; i < symbolCount; ++i) heap.push({ counts[i], i });
+
+		size_t nextNode = symbolCount;
+		while (heap.size() > 1)
+		{
+			const Node a = heap.top();
+			heap.pop();
+			const Node b = heap.top();
+			heap.pop();
+			parent[a.second] = parent[b.second] = nextNode;
+			heap.push({ a.first + b.first, nextNode++ });
+		}
+
+		const size_t root = nextNode - 1;
+		vector<uint32_t> lengths(symbolCount, 0);
+		uint32_t longest = 0;
+		for (size_t i = 0; i < symbolCount; ++i)
+		{
+			for (size_t node = i; node != root; node = parent[node]) lengths[i]++;
+			longest = max(longest, lengths[i]);
+		}
+		if (longest <= kMaxHuffmanBits) return lengths;
+
+		for (uint64_t& count : counts) count = (count >> 1) | 1;
+	}
+}
+
+OpRemapTable buildHuffmanOpTable(const DecodeAnalysis& analysis)
+{
+	OpRemapTable table = buildDenseOpTable(analysis);
+	if (!table.isDense()) return table;
+
+	unordered_map<uint16_t, uint64_t> opCounts;
+	for (const auto& spvOp : analysis.SpvOps)
+	{
+		char* end = nullptr;
+		unsigned long op = strtoul(spvOp.entry.c_str(), &end, 10);
+		if (end == spvOp.entry.c_str() || op > 0xFFFF) continue;
+		opCounts[(uint16_t)op] += spvOp.count;
+	}
+
+	// Ops the encoder may need without counts (VectorShuffle pair) get codes too
+	vector<uint64_t> counts;
+	for (uint16_t op : table.denseOps) counts.push_back(max<uint64_t>(opCounts[op], 1));
+	const vector<uint32_t> lengths = getHuffmanLengths(counts);
+
+	// Canonical order: shorter codes first, frequency order within the same length
+	vector<size_t> order(table.denseOps.size());
+	for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+	stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return lengths[a] < lengths[b]; });
+
+	vector<uint16_t> denseOps;
+	for (size_t i : order) denseOps.push_back(table.denseOps[i]);
+	table.setDenseOps(denseOps);
+
+	table.huffmanLengthCounts.assign(lengths[order.back()], 0);
+	for (uint32_t length : lengths) table.huffmanLengthCounts[length - 1]++;
+
+	return table;
+}
+
+// Code and length of each dense op code, canonical codes assigned in dense table order
+static void getHuffmanCodes(const OpRemapTable& table, vector<uint32_t>& codes, vector<uint32_t>& lengths)
+{
+	uint32_t code = 0;
+	for (size_t length = 1; length <= table.huffmanLengthCounts.size(); ++length)
+	{
+		for (uint32_t i = 0; i < table.huffmanLengthCounts[length - 1]; ++i)
+		{
+			codes.push_back(code++);
+			lengths.push_back((uint32_t)length);
+		}
+		code <<= 1;
+	}
+}
+
+// Bits of the code, highest first, to the highest free bits of the last byte
+static void writeBits(ByteArray& out, uint32_t& bitCount, uint32_t code, uint32_t length)
+{
+	for (uint32_t b = length; b-- > 0; ++bitCount)
+	{
+		if ((bitCount & 7) == 0) out.push_back(0);
+		out.back() |= uint8_t(((code >> b) & 1) << (7 - (bitCount & 7)));
+	}
+}
+
+bool crunchEncode(const ByteArray& spirv, ByteArray& outSmolv, uint32_t flags, const OpRemapTable& remapTable,
+	const StringTable* stringTable, vector<size_t>* instructionOffsets)
+{
+	const size_t wordCount = spirv.size() / 4;
+	if (wordCount * 4 != spirv.size() || wordCount < 5) return false;
+
+	vector<uint32_t> spirvWords(wordCount);
+	for (size_t i = 0; i < wordCount; ++i)
+	{
+		spirvWords[i] = spirv[i * 4] | (spirv[i * 4 + 1] << 8) | (spirv[i * 4 + 2] << 16) | ((uint32_t)spirv[i * 4 + 3] << 24);
+	}
+
+	const uint32_t* words = spirvWords.data();
+	const uint32_t* wordsEnd = words + wordCount;
+	if (words[0] != 0x07230203) return false;
+
+	outSmolv.clear();
+	outSmolv.reserve(spirv.size() / 2);
+
+	// smol-v header, decrunch skips this altogether
+	write4(outSmolv, 0x534D4F4C); // SMOL
+	write4(outSmolv, (words[1] & 0x00FFFFFF) + (1 << 24)); // SPIR-V version + smol-v version
+	write4(outSmolv, words[2]); // generator
+	write4(outSmolv, words[3]); // bound
+	write4(outSmolv, words[4]); // schema
+
+	const size_t headerSpirvSizeOffset = outSmolv.size();
+	write4(outSmolv, (uint32_t)spirv.size());
+	const size_t payloadStart = outSmolv.size();
+
+	// Huffman op codes go to their own bit stream, written ahead of the payload
+	const bool bHuffmanOps = remapTable.hasHuffmanOps();
+	vector<uint32_t> huffmanCodes;
+	vector<uint32_t> huffmanLengths;
+	if (bHuffmanOps) getHuffmanCodes(remapTable, huffmanCodes, huffmanLengths);
+	ByteArray opBits;
+	uint32_t opBitCount = 0;
+
+	// Field streams, all the same output unless columnar
+	const bool bColumnar = (flags & kCrunchEncodeFlagColumnar) != 0;
+	ByteArray columns[6];
+	ByteArray& opStream = bColumnar ? columns[0] : outSmolv;
+	ByteArray& typeStream = bColumnar ? columns[1] : outSmolv;
+	ByteArray& resultStream = bColumnar ? columns[2] : outSmolv;
+	ByteArray& operandStream = bColumnar ? columns[3] : outSmolv;
+	ByteArray& literalStream = bColumnar ? columns[4] : outSmolv;
+	ByteArray& memberStream = bColumnar ? columns[5] : outSmolv;
+
+	size_t strippedSpirvWordCount = wordCount;
+	uint32_t prevResult = 0;
+	uint32_t prevDecorate = 0;
+	uint32_t prevChainBase = 0;
+	uint32_t prevChainIndex = 0;
+
+	const bool bGroupVarint = (flags & kCrunchEncodeFlagGroupVarint) != 0;
+	vector<GroupVarintBlock> groupBlocks;
+	GroupVarintWriter operandGroups;
+	GroupVarintWriter literalGroups;
+	operandGroups.blocks = &groupBlocks;
+	literalGroups.blocks = &groupBlocks;
+
+	// Relative IDs either as delta from the result or absolute, whichever is smaller
+	const bool bIdContexts = (flags & kCrunchEncodeFlagIdContexts) != 0;
+
+	if (instructionOffsets) instructionOffsets->clear();
+
+	words += 5;
+	while (words < wordsEnd)
+	{
+		size_t instrLen = words[0] >> 16;
+		uint32_t op = words[0] & 0xFFFF;
+
+		if (instrLen < 1 || words + instrLen > wordsEnd) return false;
+
+		// Strip debug info if requested
+		if ((flags & kEncodeFlagStripDebugInfo) && opDebugInfo(op))
+		{
+			strippedSpirvWordCount -= instrLen;
+			words += instrLen;
+			continue;
+		}
+
+		if (instructionOffsets) instructionOffsets->push_back(outSmolv.size());
+
+		uint32_t swizzle;
+		const uint32_t writeOp = getWriteOp(words, instrLen, swizzle);
+
+		if (remapTable.remap((uint16_t)writeOp) == OpRemapTable::kInvalidCode) return false;
+		const uint32_t fixedLength = remapTable.fixedLength((uint16_t)writeOp);
+		if (fixedLength && fixedLength != instrLen) return false;
+		if (bHuffmanOps)
+		{
+			const uint16_t code = remapTable.remap((uint16_t)writeOp);
+			writeBits(opBits, opBitCount, huffmanCodes[code], huffmanLengths[code]);
+			writeVarint(opStream, encodeLen(writeOp, (uint32_t)instrLen));
+		}
+		else writeLengthOp(opStream, (uint32_t)instrLen, writeOp, remapTable);
+
+		// Compact pseudo ops: type and result as usual, the operands packed
+		if (op == kOpCompositeExtractCompact || op == kOpCompositeConstructCompact || op == kOpAccessChainCompact)
+		{
+			if (!fitsCompactOp(op, words, instrLen, prevChainIndex)) return false;
+			writeVarint(typeStream, words[1]);
+			writeVarint(resultStream, zigEncode(words[2] - prevResult));
+			prevResult = words[2];
+
+			if (op == kOpCompositeExtractCompact)
+			{
+				writeVarint(operandStream, (zigEncode(prevResult - words[3]) << 2) | words[4]);
+			}
+			else if (op == kOpCompositeConstructCompact)
+			{
+				uint32_t deltas = 0;
+				for (size_t i = 3; i < instrLen; ++i) deltas |= (prevResult - words[i] - 1) << ((i - 3) * 2);
+				operandStream.push_back(uint8_t(deltas));
+			}
+			else
+			{
+				writeVarint(operandStream, (zigEncode(words[4] - prevChainIndex) << 1) | (words[3] == prevChainBase));
+				if (words[3] != prevChainBase) writeVarint(operandStream, words[3]);
+				prevChainBase = words[3];
+				prevChainIndex = words[4];
+			}
+
+			words += instrLen;
+			continue;
+		}
+
+		// Splice pseudo ops have only varint operands, the op data rows of #9 and #18 don't apply
+		const bool bSplice = op == kOpSharedPrologue || op == kOpVariantCopy;
+		const CrunchOpData opInfo = bSplice ? CrunchOpData{ 0, 0, 0, 1 } : getCrunchOpData(op, remapTable.isDense());
+		size_t ioffs = 1;
+
+		// Constant literal form goes in the low bits of the type
+		const bool bConstant = (flags & kCrunchEncodeFlagConstants) && op == kOpConstant && instrLen > 3;
+		const uint32_t constantForm = bConstant ? getConstantForm(words + 3, instrLen - 3) : 0;
+
+		// write type as varint, if we have it
+		if (opInfo.hasType != 0)
+		{
+			if (ioffs >= instrLen) return false;
+			if (bConstant && words[ioffs] >= (1u << 30)) return false;
+			writeVarint(typeStream, bConstant ? (words[ioffs] << 2) | constantForm : words[ioffs]);
+			ioffs++;
+		}
+
+		// write result as delta+zig+varint, if we have it
+		if (opInfo.hasResult != 0)
+		{
+			if (ioffs >= instrLen) return false;
+			uint32_t v = words[ioffs];
+			writeVarint(resultStream, zigEncode(v - prevResult));
+			prevResult = v;
+			ioffs++;
+		}
+
+		if (bConstant)
+		{
+			for (; ioffs < instrLen; ++ioffs)
+			{
+				if (constantForm == kConstantInt) writeVarint(literalStream, zigEncode(int32_t(words[ioffs])));
+				else if (constantForm == kConstantFloat) writeVarint(literalStream, floatTransform(words[ioffs]));
+				else write4(literalStream, words[ioffs]);
+			}
+			words += instrLen;
+			continue;
+		}
+
+		// Literal string as an index to the string table, the other operands as varints
+		const size_t stringOffs = stringTable ? getStringOffset(op) : 0;
+		if (stringOffs)
+		{
+			const size_t stringWords = getStringWordCount(words, stringOffs, instrLen);
+			auto it = stringTable->indices.find(getStringKey(words + stringOffs, stringWords));
+			if (!stringWords || ioffs > stringOffs || it == stringTable->indices.end()) return false;
+
+			for (; ioffs < stringOffs; ++ioffs) writeVarint(literalStream, words[ioffs]);
+			writeVarint(literalStream, it->second);
+			for (ioffs += stringWords; ioffs < instrLen; ++ioffs) writeVarint(literalStream, words[ioffs]);
+
+			words += instrLen;
+			continue;
+		}
+
+		// Decorate & MemberDecorate: IDs relative to previous decorate
+		if (op == kOpDecorate || op == kOpMemberDecorate)
+		{
+			if (ioffs >= instrLen) return false;
+			uint32_t v = words[ioffs];
+			writeVarint(operandStream, zigEncode(v - prevDecorate));
+			prevDecorate = v;
+			ioffs++;
+		}
+
+		// MemberDecorate special encoding: row of MemberDecorates for the same type is written as one
+		if (op == kOpMemberDecorate)
+		{
+			const uint32_t decorationType = words[ioffs - 1];
+			const uint32_t* memberWords = words;
+			uint32_t prevIndex = 0;
+			uint32_t prevOffset = 0;
+
+			// write a byte on how many we have encoded as a bunch
+			size_t countLocation = memberStream.size();
+			memberStream.push_back(0);
+			int count = 0;
+			while (memberWords < wordsEnd && count < 255)
+			{
+				size_t memberLen = memberWords[0] >> 16;
+				uint32_t memberOp = memberWords[0] & 0xFFFF;
+				if (memberOp != kOpMemberDecorate) break;
+				if (memberLen < 4 || memberWords + memberLen > wordsEnd) return false;
+				if (memberWords[1] != decorationType) break;
+
+				// write member index as delta from previous
+				uint32_t memberIndex = memberWords[2];
+				writeVarint(memberStream, memberIndex - prevIndex);
+				prevIndex = memberIndex;
+
+				// decoration (and length if not common/known)
+				uint32_t memberDec = memberWords[3];
+				writeVarint(memberStream, memberDec);
+				const int knownExtraOps = decorationExtraOps(memberDec);
+				if (knownExtraOps == -1)
+					writeVarint(memberStream, (uint32_t)memberLen - 4);
+				else if (unsigned(knownExtraOps) + 4 != memberLen)
+					return false;
+
+				// Offset decorations are most often linearly increasing, so encode as deltas
+				if (memberDec == 35)
+				{
+					if (memberLen != 5) return false;
+					writeVarint(memberStream, memberWords[4] - prevOffset);
+					prevOffset = memberWords[4];
+				}
+				else
+				{
+					for (size_t i = 4; i < memberLen; ++i)
+						writeVarint(memberStream, memberWords[i]);
+				}
+
+				memberWords += memberLen;
+				++count;
+			}
+			memberStream[countLocation] = uint8_t(count);
+			words = memberWords;
+			continue;
+		}
+
+		// Write out this many IDs, encoding them relative+zigzag to result ID
+		int relativeCount = opInfo.deltaFromResult;
+		for (int i = 0; i < relativeCount && ioffs < instrLen; ++i, ++ioffs)
+		{
+			uint32_t v = zigEncode(prevResult - words[ioffs]);
+			if (bIdContexts)
+			{
+				const bool bAbsolute = words[ioffs] < v;
+				v = bAbsolute ? words[ioffs] : v;
+				if (v >= (1u << 31)) return false;
+				v = (v << 1) | (bAbsolute ? 1 : 0);
+			}
+			if (bGroupVarint) operandGroups.write(operandStream, v);
+			else writeVarint(operandStream, v);
+		}
+
+		if (writeOp == kOpVectorShuffleCompact)
+		{
+			// compact vector shuffle, just write out single swizzle byte
+			literalStream.push_back(uint8_t(swizzle));
+		}
+		else if (opInfo.varrest != 0)
+		{
+			// write out rest of words with variable encoding (expected to be small integers)
+			for (; ioffs < instrLen; ++ioffs)
+			{
+				// splice operands stay plain varints, decrunch reads them before the op data
+				if (bGroupVarint && !bSplice) literalGroups.write(literalStream, words[ioffs]);
+				else writeVarint(literalStream, words[ioffs]);
+			}
+		}
+		else
+		{
+			// write out rest of words without any encoding
+			for (; ioffs < instrLen; ++ioffs)
+				write4(literalStream, words[ioffs]);
+		}
+
+		words += instrLen;
+	}
+
+	if (bGroupVarint)
+	{
+		operandGroups.finish();
+		literalGroups.finish();
+		spliceGroupVarints(groupBlocks);
+	}
+
+	// Columnar payload: sizes of the field streams, the field streams, op/len stream last
+	if (bColumnar)
+	{
+		for (int c = 1; c < 6; ++c) writeVarint(outSmolv, (uint32_t)columns[c].size());
+		for (int c = 1; c < 6; ++c) outSmolv.insert(outSmolv.end(), columns[c].begin(), columns[c].end());
+		outSmolv.insert(outSmolv.end(), opStream.begin(), opStream.end());
+	}
+
+	// Huffman op stream: size and the bits, before the other streams
+	if (bHuffmanOps)
+	{
+		ByteArray opBitStream;
+		writeVarint(opBitStream, (uint32_t)opBits.size());
+		opBitStream.insert(opBitStream.end(), opBits.begin(), opBits.end());
+		outSmolv.insert(outSmolv.begin() + payloadStart, opBitStream.begin(), opBitStream.end());
+	}
+
+	// Group varint values are 4 byte loads, padding for the last group of the payload
+	if (bGroupVarint) outSmolv.insert(outSmolv.end(), 3, 0);
+
+	if (strippedSpirvWordCount != wordCount)
+	{
+		uint32_t strippedSize = (uint32_t)strippedSpirvWordCount * 4;
+		for (int i = 0; i < 4; ++i)
+			outSmolv[headerSpirvSizeOffset + i] = (strippedSize >> (i * 8)) & 0xFF;
+	}
+
+	return true;
+}
+
+// Licence for smol-v
+// ------------------------------------------------------------------------------
+// Copyright (c) 2016-2024 Aras Pranckevicius
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// ------------------------------------------------------------------------------
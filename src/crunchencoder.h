@@ -0,0 +1,156 @@
+﻿// crunchencoder.h - smol-v compatible encoder with spirvcruncher extensions
+//
+// (c) 2025 Ossi Luoto
+
+#pragma once
+
+#include "smolv.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Metadata about SPIR-V operations, same as kSpirvOpData in the template
+struct CrunchOpData {
+	uint8_t hasResult;	// does it have result ID?
+	uint8_t hasType;	// does it have type ID?
+	uint8_t deltaFromResult; // How many words after (optional) type+result to write out as deltas from result?
+	uint8_t varrest;	// should the rest of words be written in varint encoding?
+};
+
+// Ops above the template table (ray tracing, ray query, mesh shading) have metadata only with
+// bExtendedOps, smol-v and the default decrunch write them out as raw words.
+CrunchOpData getCrunchOpData(uint32_t op, bool bExtendedOps);
+
+// Name of an extended op for the generated comments, nullptr if not known
+const char* getExtendedOpName(uint32_t op);
+
+// Op remap table derived from the analysis of the actual inputs. Each entry swaps a hot op
+// with a rarely used op value below 16, so that the hot op gets a single nibble op code.
+// Same idea as _SMOLV_SWAP_OP list in smol-v, but trained with our own shaders.
+
+struct OpRemapEntry {
+	uint16_t op;
+	uint16_t code;
+	double share;	// percentage of all decoded instructions, for the generated comments
+};
+
+struct OpRemapTable {
+	std::vector<OpRemapEntry> swaps;
+
+	// Dense op table: op code in the stream is the index of the op in this list. Decoder
+	// maps it back with the same list, so unused ops take no space in the op data table.
+	std::vector<uint16_t> denseOps;
+	std::unordered_map<uint16_t, uint16_t> denseCodes;
+
+	void setDenseOps(const std::vector<uint16_t>& ops);
+	bool isDense() const { return !denseOps.empty(); }
+
+	// Fixed length ops are last in the dense table and their op/len word has no length. Low
+	// nibbles below variableNibbles are the other ops, the rest with the bits above the nibble
+	// index the fixed length ops, so that up to 8 of them per nibble fit in one byte.
+	std::vector<uint8_t> fixedLengths;	// length of each fixed length op, in dense table order
+	uint32_t variableNibbles = 16;
+
+	bool hasFixedLengths() const { return !fixedLengths.empty(); }
+	size_t variableOpCount() const { return denseOps.size() - fixedLengths.size(); }
+
+	// Canonical Huffman codes of the dense op codes, as the number of codes of each bit length
+	// from 1 up. Dense table is in canonical order, so the code lengths never decrease along it.
+	std::vector<uint16_t> huffmanLengthCounts;
+
+	bool hasHuffmanOps() const { return !huffmanLengthCounts.empty(); }
+
+	// Returns kInvalidCode for an op missing from the dense table
+	uint16_t remap(uint16_t op) const;
+
+	// Length of a fixed length op, 0 for the other ops
+	uint32_t fixedLength(uint16_t op) const;
+
+	static const uint16_t kInvalidCode = 0xFFFF;
+};
+
+// smol-v default op remap, for crunchEncode output that the default decrunch reads
+OpRemapTable getSmolvRemapTable();
+
+// Pick the 16 most frequent ops from the (merged) decode analysis and give them single nibble codes
+OpRemapTable buildOpRemapTable(const smolv::DecodeAnalysis& analysis);
+
+// Dense op table of the ops in the (merged) decode analysis, most frequent first, so that the hot
+// ops get single nibble codes as with the remap table
+OpRemapTable buildDenseOpTable(const smolv::DecodeAnalysis& analysis);
+
+// Payload as separate field streams (op/len, types, results, relative operands, literals,
+// MemberDecorate runs) instead of interleaved fields, for decrunch with the columnar option
+static const uint32_t kCrunchEncodeFlagColumnar = 1 << 16;
+
+// OpConstant literals in the smallest of three forms, zigzag varint for ints, float transform
+// varint for floats with short mantissas, or raw words. Form is in the low two bits of the type.
+static const uint32_t kCrunchEncodeFlagConstants = 1 << 17;
+
+// Relative IDs and the varint rest words as group varints: a control byte of 2 bit byte counts for
+// each four values, then the four values in 1-4 bytes, at the place of the first value, so that
+// decrunch decodes a group at once without a branch per byte. Payload ends in 3 bytes of padding.
+static const uint32_t kCrunchEncodeFlagGroupVarint = 1 << 18;
+
+// Relative IDs against two contexts: the zigzag delta from the result or the absolute ID, the
+// smaller, with the selector in the low bit. Operands of types, constants and globals are far
+// behind the result but small after renumbering.
+static const uint32_t kCrunchEncodeFlagIdContexts = 1 << 19;
+
+// Dense op table where the ops that have the same length in every instruction of the modules go
+// last, written without length. Modules are read as crunchEncode writes them, compact VectorShuffle
+// as its own op and without the debug info kEncodeFlagStripDebugInfo strips. The nibble split is
+// the one that writes the op/len words of the modules in the fewest bytes.
+OpRemapTable buildFixedLengthOpTable(const smolv::DecodeAnalysis& analysis, const std::vector<const smolv::ByteArray*>& modules,
+	uint32_t flags);
+
+// Longest Huffman op code, counts are flattened until the codes fit
+static const uint32_t kMaxHuffmanBits = 12;
+
+// Dense op table with canonical Huffman codes from the op counts of the analysis. The op codes go
+// to a bit stream ahead of the payload, and the op/len word is only the length.
+OpRemapTable buildHuffmanOpTable(const smolv::DecodeAnalysis& analysis);
+
+// Pseudo op in place of the shared prologue declarations of a section. Operands are (skip, take)
+// instruction counts over the shared prologue, written as varints.
+static const uint32_t kOpSharedPrologue = 18;
+
+// Pseudo op in a variant payload in place of instructions that are the same in the base shader.
+// Operands are (skip, take) instruction counts over the decoded base, written as varints.
+static const uint32_t kOpVariantCopy = 9;
+
+// Pseudo op in place of a run of instructions stored once in shared_macros. Operand is the index of
+// the run, written as a varint. Decrunch reads the run from the dictionary with its own state, so
+// the relative IDs of the run decode against the results before the reference.
+static const uint32_t kOpMacro = 40;
+
+// Writes a kOpMacro reference to the run at the index
+void writeMacroReference(smolv::ByteArray& out, uint32_t index, const OpRemapTable& remapTable);
+
+// Rewrites the CompositeExtract, CompositeConstruct and AccessChain instructions of the payload
+// module that fit a compact form to pseudo ops #76, #85 and #58, and returns their count. Words
+// stay the same, only the op changes, so the smol-v analysis counts the pseudo ops for the op tables.
+// Payload is expected without the debug info the encoder would strip.
+size_t rewriteCompactOps(smolv::ByteArray& payload);
+
+// Literal strings of OpSourceExtension, OpName, OpMemberName, OpString, OpExtension, OpExtInstImport,
+// OpEntryPoint and OpModuleProcessed over all shaders, stored once in shared_strings. Entries are
+// the word count and the string words, most used first, and payloads refer to them by index.
+struct StringTable {
+	std::vector<uint32_t> words;
+	std::unordered_map<std::string, uint32_t> indices;	// string words as bytes to entry index
+};
+
+// Table of the strings in the modules, leaving out the ones kEncodeFlagStripDebugInfo strips
+StringTable buildStringTable(const std::vector<const smolv::ByteArray*>& modules, uint32_t flags);
+
+// Encode SPIR-V to smol-v stream using given op remap. Output matches smolv::Encode byte by byte,
+// except for the op codes, and extended ops when the table is dense. Flags are smol-v encode
+// flags (kEncodeFlagStripDebugInfo) and the kCrunchEncodeFlag flags. With a string table, the
+// string ops are written as varint operands around the index of the string. Fails on an instruction
+// of a fixed length op with another length. Instruction offsets, if given, are the output offsets of
+// the instructions of an interleaved payload, a MemberDecorate run as one.
+bool crunchEncode(const smolv::ByteArray& spirv, smolv::ByteArray& outSmolv, uint32_t flags, const OpRemapTable& remapTable,
+	const StringTable* stringTable = nullptr, std::vector<size_t>* instructionOffsets = nullptr);
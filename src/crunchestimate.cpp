@@ -0,0 +1,147 @@
+﻿// crunchestimate.cpp - packed size estimate with a context mixing model
+//
+// (c) 2025 Ossi Luoto
+
+#include "crunchestimate.h"
+
+#include <math.h>
+
+using namespace std;
+using namespace smolv;
+
+static const uint32_t kSlotBits = 22;
+static const uint16_t kCountLimit = 60;
+static const float kLearningRate = 0.02f;
+
+// Lookup tables over 12 bit probabilities, the model runs over whole corpora
+struct EstimateTables {
+	float stretch[4096];	// ln(p / (1 - p))
+	float cost[4096];		// -log2(p)
+
+	EstimateTables()
+	{
+		for (int i = 0; i < 4096; ++i)
+		{
+			float p = (i + 0.5f) / 4096.0f;
+			stretch[i] = logf(p / (1.0f - p));
+			cost[i] = -log2f(p);
+		}
+	}
+};
+
+static const EstimateTables kTables;
+
+static int squash12(float x)
+{
+	int p = (int)(4096.0f / (1.0f + expf(-x)));
+	return p < 1 ? 1 : (p > 4095 ? 4095 : p);
+}
+
+static uint32_t hashContext(uint64_t bytes, uint32_t model)
+{
+	uint64_t h = (bytes + model) * 0x9E3779B97F4A7C15ull;
+	return (uint32_t)(h >> 32) ^ (model << 28);
+}
+
+PackEstimator::PackEstimator()
+	: slots(size_t(1) << kSlotBits, Slot{ 0x8000, 0 })
+{
+	for (auto& set : weights)
+	{
+		for (float& weight : set) weight = 0.3f;
+	}
+	updateContexts();
+}
+
+void PackEstimator::updateContexts()
+{
+	// Orders 0, 1, 2, 3, 4 and 6, then sparse contexts of bytes 2-3 back and 4 back, which catch
+	// the fixed layout of smol-v instructions
+	static const uint64_t kMasks[kModels] = {
+		0, 0xFF, 0xFFFF, 0xFFFFFF, 0xFFFFFFFF, 0xFFFFFFFFFFFFull, 0xFFFF00, 0xFF000000,
+	};
+	for (uint32_t m = 0; m < kModels; ++m) contextHashes[m] = hashContext(history & kMasks[m], m);
+}
+
+double PackEstimator::code(const uint8_t* data, size_t size)
+{
+	const uint32_t slotMask = (1u << kSlotBits) - 1;
+	double bits = 0.0;
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		uint32_t partial = 1;	// bits of the current byte so far, with a leading one
+		for (int bit = 7; bit >= 0; --bit)
+		{
+			const int y = (data[i] >> bit) & 1;
+			float* weightSet = weights[7 - bit];
+
+			Slot* active[kModels];
+			float inputs[kModels + 1];
+			float dot = 0.0f;
+			for (uint32_t m = 0; m < kModels; ++m)
+			{
+				active[m] = &slots[(contextHashes[m] + partial * 0x2F0B4C93u) & slotMask];
+				inputs[m] = kTables.stretch[active[m]->p >> 4];
+				dot += inputs[m] * weightSet[m];
+			}
+			inputs[kModels] = 0.3f;	// bias
+			dot += inputs[kModels] * weightSet[kModels];
+
+			int p = squash12(dot);
+			bits += kTables.cost[y ? p : 4096 - p];
+
+			// Mixer learns towards the coded bit, counters adapt fast first and then settle
+			float error = (float)y - p / 4096.0f;
+			for (uint32_t m = 0; m <= kModels; ++m) weightSet[m] += kLearningRate * error * inputs[m];
+
+			for (uint32_t m = 0; m < kModels; ++m)
+			{
+				Slot& slot = *active[m];
+				int target = y ? 65535 : 0;
+				slot.p = (uint16_t)(slot.p + (target - (int)slot.p) / (slot.n + 2));
+				if (slot.n < kCountLimit) slot.n++;
+			}
+
+			partial = (partial << 1) | y;
+		}
+
+		history = (history << 8) | data[i];
+		updateContexts();
+	}
+
+	totalBits += bits;
+	return bits / 8.0;
+}
+
+PackEstimate estimatePackedSize(
+	const vector<EncodedShader>& shaders,
+	const vector<uint32_t>& sharedPrologue,
+	const vector<uint32_t>& sharedStrings,
+	const ByteArray& sharedMacros,
+	const vector<uint32_t>& sharedMacroOffsets,
+	bool bSkipCruncher,
+	const string& decoderText)
+{
+	PackEstimate estimate;
+
+	PackEstimator payload;
+	estimate.prologueBytes = payload.code((const uint8_t*)sharedPrologue.data(), sharedPrologue.size() * 4);
+	estimate.stringTableBytes = payload.code((const uint8_t*)sharedStrings.data(), sharedStrings.size() * 4);
+	estimate.macroBytes = payload.code((const uint8_t*)sharedMacroOffsets.data(), sharedMacroOffsets.size() * 4);
+	estimate.macroBytes += payload.code(sharedMacros.data(), sharedMacros.size());
+	size_t skipHeader = bSkipCruncher ? 0 : headerToSkip;
+	for (const auto& shader : shaders)
+	{
+		estimate.shaderBytes.push_back(payload.code(shader.smolv.data() + skipHeader, shader.smolv.size() - skipHeader));
+	}
+	estimate.payloadBytes = payload.totalBytes();
+
+	if (!decoderText.empty())
+	{
+		PackEstimator decoder;
+		estimate.decoderBytes = decoder.code((const uint8_t*)decoderText.data(), decoderText.size());
+	}
+
+	return estimate;
+}
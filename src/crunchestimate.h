@@ -0,0 +1,61 @@
+﻿// crunchestimate.h - packed size estimate with a context mixing model
+//
+// (c) 2025 Ossi Luoto
+
+#pragma once
+
+#include "crunchheader.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Bitwise context mixing model in the spirit of crinkler and kkrunchy: order 0-4 and 6 contexts and
+// two sparse contexts, mixed in the logistic domain. The model is not a packer, only the ideal code
+// length of each bit is summed, which tracks the final packed size well enough to compare options.
+class PackEstimator {
+public:
+	PackEstimator();
+
+	// Codes data after everything coded before with the same model state, as the packer sees one
+	// section, and returns the estimated compressed size of this data in bytes
+	double code(const uint8_t* data, size_t size);
+
+	double totalBytes() const { return totalBits / 8.0; }
+
+private:
+	static const int kModels = 8;
+
+	struct Slot {
+		uint16_t p;		// probability of 1, 16 bits
+		uint16_t n;		// adaptation count
+	};
+
+	std::vector<Slot> slots;
+	uint32_t contextHashes[kModels] = {};
+	uint64_t history = 0;	// previous bytes, newest lowest
+	float weights[8][kModels + 1];
+	double totalBits = 0.0;
+
+	void updateContexts();
+};
+
+struct PackEstimate {
+	std::vector<double> shaderBytes;	// cost of each payload after the payloads before it
+	double payloadBytes = 0.0;			// .smolv section, shared prologue included
+	double prologueBytes = 0.0;			// shared prologue, coded first
+	double stringTableBytes = 0.0;		// shared strings, coded after the prologue
+	double macroBytes = 0.0;			// macro dictionary, offsets and runs, coded after the strings
+	double decoderBytes = 0.0;			// decrunch source text, a relative measure between decoder options only
+};
+
+// Shared prologue, string table, macro dictionary and payloads are coded in the emission order as
+// one section, decoder text with its own model
+PackEstimate estimatePackedSize(
+	const std::vector<EncodedShader>& shaders,
+	const std::vector<uint32_t>& sharedPrologue,
+	const std::vector<uint32_t>& sharedStrings,
+	const smolv::ByteArray& sharedMacros,
+	const std::vector<uint32_t>& sharedMacroOffsets,
+	bool bSkipCruncher,
+	const std::string& decoderText);
@@ -0,0 +1,237 @@
+﻿// crunchheader.cpp - output header generation
+//
+// (c) 2025 Ossi Luoto
+
+#include "crunchheader.h"
+#include "crunchtemplate.h"
+
+#include <iomanip>
+#include <chrono>
+#include <ctime>
+
+using namespace std;
+using namespace smolv;
+
+size_t headerToSkip = 24;
+
+static void writeWordArray(ostream& outputFile, const char* name, const vector<uint32_t>& words)
+{
+	outputFile << "const uint32_t " << name << "[] = {\n\n";
+	for (size_t i = 0; i < words.size(); ++i) {
+		if (i % 8 == 0) outputFile << "    ";
+		outputFile << "0x" << std::hex << std::setw(8) << std::setfill('0') << words[i] << std::dec;
+		if (i != words.size() - 1) outputFile << ", ";
+		if (i % 8 == 7) outputFile << "\n";
+	}
+	outputFile << "\n};\n\n";
+}
+
+static void writeByteArray(ostream& outputFile, const string& name, const uint8_t* data, size_t size)
+{
+	outputFile << "const uint8_t " << name << "[] = {\n\n";
+
+	size_t count = 0;
+	for (size_t i = 0; i < size; ++i) {
+		if (count % 12 == 0) outputFile << "    ";
+
+		outputFile << "0x" << std::hex << std::setw(2) << std::setfill('0')
+			<< static_cast<int>(data[i]);
+
+		if (i != size - 1) outputFile << ", ";
+		++count;
+		if (count % 12 == 0) outputFile << "\n";
+	}
+
+	outputFile << "\n};\n\n";
+}
+
+bool generateUberHeader(
+	ostream& outputFile,
+	const string& decoderText,
+	const vector<EncodedShader>& shaders,
+	const vector<uint32_t>& sharedPrologue,
+	const vector<uint32_t>& sharedStrings,
+	const ByteArray& sharedMacros,
+	const vector<uint32_t>& sharedMacroOffsets,
+	bool bSkipCruncher)
+{
+	//
+	// 1. Header 
+	//
+
+	{
+		outputFile << "//\n// Generated with spirvcruncher on: ";
+		// Timestamp
+		auto now = chrono::system_clock::now();
+		time_t now_time = chrono::system_clock::to_time_t(now);
+		tm* local_time = localtime(&now_time);
+		outputFile << std::put_time(local_time, "%Y-%m-%d %H:%M:%S");
+
+		outputFile << "\n//\n";
+
+		writeTemplateHeader(outputFile);
+	}
+
+	//
+	// 2. Shadercode
+	//
+	// First, check if all shaders share the same SPIR-V Version to optimize size
+
+	bool allVersionsMatch = true;
+	uint32_t sharedVersionWord = 0;
+
+	for (size_t i = 0; i < shaders.size(); ++i) {
+		// Reconstruct the 32-bit version word correctly from little-endian bytes
+		uint32_t versionWord = shaders[i].spirv[4] |
+			(shaders[i].spirv[5] << 8) |
+			(shaders[i].spirv[6] << 16) |
+			(shaders[i].spirv[7] << 24);
+
+		if (i == 0) sharedVersionWord = versionWord;
+		else if (versionWord != sharedVersionWord) allVersionsMatch = false;
+	}
+
+	if (allVersionsMatch && !shaders.empty()) {
+		outputFile << "constexpr uint32_t shared_spvVersion = 0x"
+			<< std::hex << std::setw(8) << std::setfill('0') << sharedVersionWord << std::dec << ";\n\n";
+	}
+
+	// PASS 1: Group all packed bytes together in one Data Segment
+
+	outputFile << "// --- Compressed Shader Payloads ---\n";
+	outputFile << "#pragma data_seg(\".smolv\")\n\n";
+
+	if (!sharedPrologue.empty()) writeWordArray(outputFile, "shared_prologue", sharedPrologue);
+	if (!sharedStrings.empty()) writeWordArray(outputFile, "shared_strings", sharedStrings);
+	if (!sharedMacros.empty()) {
+		writeWordArray(outputFile, "shared_macro_offsets", sharedMacroOffsets);
+		writeByteArray(outputFile, "shared_macros", sharedMacros.data(), sharedMacros.size());
+	}
+
+	for (const auto& shader : shaders) {
+		// For debugging
+		size_t skipHeader = bSkipCruncher ? 0 : headerToSkip;
+		size_t dataSizeNoHeader = shader.smolv.size() - skipHeader;
+
+		writeByteArray(outputFile, shader.name, shader.smolv.data() + skipHeader, dataSizeNoHeader);
+	}
+
+	// Reset data segment to default
+	outputFile << "#pragma data_seg()\n\n";
+
+	// PASS 2: Group all metadata together
+
+	outputFile << "// --- Metadata ---\n";
+	for (const auto& shader : shaders) {
+		size_t skipHeader = bSkipCruncher ? 0 : headerToSkip;
+		size_t dataSizeNoHeader = shader.smolv.size() - skipHeader;
+
+		outputFile << std::dec << std::setw(0) << std::setfill(' ');
+		outputFile << "constexpr size_t " << shader.name << "_encoded_sizeInBytes = " << dataSizeNoHeader << ";\n";
+		outputFile << "constexpr size_t " << shader.name << "_sizeInBytes = " << shader.decodedSize << ";\n";
+		if (!shader.baseName.empty()) outputFile << "// variant of " << shader.baseName << ", decrunch with decrunch_base = " << shader.baseName << "_buffer\n";
+
+		if (!bSkipCruncher) {
+			if (!allVersionsMatch) {
+				uint32_t versionWord = shader.spirv[4] | (shader.spirv[5] << 8) | (shader.spirv[6] << 16) | (shader.spirv[7] << 24);
+				outputFile << "constexpr uint32_t " << shader.name << "_spvVersion = 0x"
+					<< std::hex << std::setw(8) << std::setfill('0') << versionWord << std::dec << ";\n";
+			}
+
+			uint32_t boundWord = shader.spirv[12] | (shader.spirv[13] << 8) | (shader.spirv[14] << 16) | (shader.spirv[15] << 24);
+			outputFile << "constexpr uint32_t " << shader.name << "_spvBound = 0x"
+				<< std::hex << std::setw(8) << std::setfill('0') << boundWord << std::dec << ";\n";
+		}
+		outputFile << "\n";
+	}
+
+
+
+	/*
+		outputFile << std::dec << std::setw(0) << std::setfill(' ');
+//		outputFile << "constexpr size_t " << shader.name << "_encoded_sizeInBytes = " << dataSizeNoHeader << ";\n";
+		outputFile << "constexpr size_t " << shader.name << "_sizeInBytes = " << shader.decodedSize << "; \n";
+
+		if (!bSkipCruncher)
+		{
+			if (!allVersionsMatch) {
+				uint32_t versionWord = shader.spirv[4] | (shader.spirv[5] << 8) | (shader.spirv[6] << 16) | (shader.spirv[7] << 24);
+				outputFile << "constexpr uint32_t " << shader.name << "_spvVersion = 0x"
+					<< std::hex << std::setw(8) << std::setfill('0') << versionWord << std::dec << ";\n";
+			}
+
+			// Reconstruct Bound correctly
+			uint32_t boundWord = shader.spirv[12] | (shader.spirv[13] << 8) | (shader.spirv[14] << 16) | (shader.spirv[15] << 24);
+			outputFile << "constexpr uint32_t " << shader.name << "_spvBound = 0x"
+				<< std::hex << std::setw(8) << std::setfill('0') << boundWord << std::dec << ";\n";
+		}
+		*/
+
+	// PASS 3: Group all uninitialized buffers in the BSS Segment
+
+	outputFile << "// --- Uninitialized Memory Buffers (BSS) ---\n";
+	outputFile << "#pragma bss_seg(\".spirvbss\")\n\n";
+
+	for (const auto& shader : shaders) {
+		size_t bufferWords = (shader.decodedSize + 3) / 4;
+
+		outputFile << "inline uint32_t " << shader.name << "_buffer[" << bufferWords << "];\n";
+	}
+
+	// Reset bss segment to default
+	outputFile << "\n#pragma bss_seg()\n\n";
+
+	/*
+		// Allocate zero-initialized 32-bit aligned space
+		size_t bufferWords = (shader.decodedSize + 3) / 4;
+		outputFile << "inline uint32_t " << shader.name << "_buffer[" << bufferWords << "] = {};\n\n";
+	}
+	*/
+
+	// Generate debug "decoder" and macro
+	if (bSkipCruncher)
+	{
+		outputFile << "// BYPASS MODE: smol-v decrunch skipped. Doing raw 32-bit copy.\n";
+		outputFile << "inline void decrunch_bypass(const uint8_t* src, size_t sizeInBytes, uint32_t* dst) {\n";
+		outputFile << "\tconst uint32_t* src32 = (const uint32_t*)src;\n";
+		outputFile << "\tfor (size_t i = 0; i < sizeInBytes / 4; ++i) {\n";
+		outputFile << "\t\tdst[i] = src32[i];\n";
+		outputFile << "\t}\n";
+		outputFile << "}\n\n";
+
+		outputFile << "#define DECRUNCH_ALL_SHADERS() \\\n";
+		for (size_t i = 0; i < shaders.size(); ++i) {
+			const auto& s = shaders[i];
+			outputFile << "\tdecrunch_bypass(" << s.name << ", " << s.name << "_sizeInBytes, " << s.name << "_buffer)";
+			if (i < shaders.size() - 1) outputFile << "; \\\n";
+			else outputFile << "\n\n";
+		}
+	}
+	else
+	{
+		// Variants after the base shaders, each with its decoded base
+		vector<const EncodedShader*> decrunchOrder;
+		for (const auto& s : shaders) {
+			if (s.baseName.empty()) decrunchOrder.push_back(&s);
+		}
+		for (const auto& s : shaders) {
+			if (!s.baseName.empty()) decrunchOrder.push_back(&s);
+		}
+
+		outputFile << "// Macro to decrunch all shaders into their respective buffers\n";
+		outputFile << "#define DECRUNCH_ALL_SHADERS() \\\n";
+		for (size_t i = 0; i < decrunchOrder.size(); ++i) {
+			const auto& s = *decrunchOrder[i];
+			string v = allVersionsMatch ? "shared_spvVersion" : s.name + "_spvVersion";
+			if (!s.baseName.empty()) outputFile << "\tdecrunch_base = " << s.baseName << "_buffer; \\\n";
+			outputFile << "\tdecrunch(" << s.name << ", " << s.name << " + " << s.name << "_encoded_sizeInBytes, " << v << ", " << s.name << "_spvBound, (uint8_t*)" << s.name << "_buffer)";
+			if (i < decrunchOrder.size() - 1) outputFile << "; \\\n";
+			else outputFile << "\n\n";
+		}
+
+		// Decoder may be left out to share one decoder between several payload headers
+		outputFile << decoderText;
+	}
+
+	return outputFile.good();
+}
@@ -0,0 +1,36 @@
+﻿// crunchheader.h - output header generation
+//
+// (c) 2025 Ossi Luoto
+
+#pragma once
+
+#include "smolv.h"
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+// smol-v header is skipped in the payload, decrunch gets version and bound as arguments
+extern size_t headerToSkip;
+
+struct EncodedShader {
+	std::string name;
+	smolv::ByteArray spirv;			// module decrunch writes
+	smolv::ByteArray payloadSpirv;	// module to encode when it differs from spirv (shared prologue)
+	smolv::ByteArray smolv;
+	size_t decodedSize = 0;
+	std::string baseName;			// variant payloads copy instructions from this decoded shader
+};
+
+// Writes payloads, metadata, buffers, DECRUNCH_ALL_SHADERS and the decoder text (empty to leave it out).
+// Shared prologue, string table and macro dictionary go in front of the payloads, when the payloads
+// refer to them.
+bool generateUberHeader(
+	std::ostream& outputFile,
+	const std::string& decoderText,
+	const std::vector<EncodedShader>& shaders,
+	const std::vector<uint32_t>& sharedPrologue,
+	const std::vector<uint32_t>& sharedStrings,
+	const smolv::ByteArray& sharedMacros,
+	const std::vector<uint32_t>& sharedMacroOffsets,
+	bool bSkipCruncher);
@@ -0,0 +1,259 @@
+﻿// crunchmacro.cpp - dictionary of instruction runs repeated across the payloads
+//
+// (c) 2025 Ossi Luoto
+
+#include "crunchmacro.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+using namespace smolv;
+
+static const size_t kMinRun = 2;		// instructions, also the length of the hashed prefix
+static const size_t kMaxRun = 256;
+static const size_t kMinRunBytes = 64;	// packer finds the shorter repeats as well on its own
+static const size_t kMaxChain = 16;		// earlier places checked for each place
+static const int kMaxPasses = 8;
+
+// Payloads as indices to the distinct encoded instructions, a MemberDecorate run as one
+struct MacroInput {
+	vector<vector<uint32_t>> shaderIds;
+	vector<ByteArray> instructions;		// bytes of each distinct instruction
+};
+
+struct MacroCandidate {
+	vector<uint32_t> ids;
+	size_t bytes = 0;
+	size_t uses = 0;
+	bool bAlive = true;
+};
+
+struct MacroUse {
+	size_t position;
+	uint32_t candidate;
+};
+
+static uint64_t getPrefixKey(const vector<uint32_t>& ids, size_t position)
+{
+	return ((uint64_t)ids[position] << 32) | ids[position + 1];
+}
+
+static MacroInput buildMacroInput(const vector<EncodedShader>& shaders, const vector<vector<size_t>>& instructionOffsets)
+{
+	MacroInput input;
+	unordered_map<string, uint32_t> distinct;
+
+	for (size_t s = 0; s < shaders.size(); ++s)
+	{
+		const ByteArray& smolv = shaders[s].smolv;
+		const vector<size_t>& offsets = instructionOffsets[s];
+		vector<uint32_t> ids;
+		for (size_t i = 0; i < offsets.size(); ++i)
+		{
+			const size_t end = i + 1 < offsets.size() ? offsets[i + 1] : smolv.size();
+			string key((const char*)smolv.data() + offsets[i], end - offsets[i]);
+			auto it = distinct.emplace(key, (uint32_t)input.instructions.size()).first;
+			if (it->second == input.instructions.size()) input.instructions.emplace_back(smolv.begin() + offsets[i], smolv.begin() + end);
+			ids.push_back(it->second);
+		}
+		input.shaderIds.push_back(std::move(ids));
+	}
+
+	return input;
+}
+
+static size_t getRunBytes(const MacroInput& input, const vector<uint32_t>& ids, size_t position, size_t count)
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < count; ++i) bytes += input.instructions[ids[position + i]].size();
+	return bytes;
+}
+
+// LZ style greedy parse over all payloads, each longest match of kMinRunBytes or more with an
+// earlier place is a candidate run
+static vector<MacroCandidate> findMacroCandidates(const MacroInput& input)
+{
+	vector<MacroCandidate> candidates;
+	map<vector<uint32_t>, uint32_t> known;
+
+	struct Place { uint32_t shader; uint32_t position; };
+	unordered_map<uint64_t, vector<Place>> chains;
+
+	for (size_t s = 0; s < input.shaderIds.size(); ++s)
+	{
+		const vector<uint32_t>& ids = input.shaderIds[s];
+		size_t p = 0;
+		while (p + kMinRun <= ids.size())
+		{
+			vector<Place>& chain = chains[getPrefixKey(ids, p)];
+
+			size_t bestCount = 0;
+			size_t bestBytes = 0;
+			for (const Place& place : chain)
+			{
+				const vector<uint32_t>& earlier = input.shaderIds[place.shader];
+				size_t count = 0;
+				while (count < kMaxRun && p + count < ids.size() && place.position + count < earlier.size() &&
+					earlier[place.position + count] == ids[p + count]) count++;
+				const size_t bytes = getRunBytes(input, ids, p, count);
+				if (bytes > bestBytes)
+				{
+					bestBytes = bytes;
+					bestCount = count;
+				}
+			}
+
+			if (chain.size() == kMaxChain) chain.erase(chain.begin());
+			chain.push_back({ (uint32_t)s, (uint32_t)p });
+
+			if (bestCount < kMinRun || bestBytes < kMinRunBytes)
+			{
+				p++;
+				continue;
+			}
+
+			vector<uint32_t> run(ids.begin() + p, ids.begin() + p + bestCount);
+			if (known.emplace(run, (uint32_t)candidates.size()).second)
+			{
+				MacroCandidate candidate;
+				candidate.ids = std::move(run);
+				candidate.bytes = bestBytes;
+				candidates.push_back(std::move(candidate));
+			}
+
+			// Places inside the match stay in the chains for the later matches
+			for (size_t i = 1; i < bestCount && p + i + kMinRun <= ids.size(); ++i)
+			{
+				vector<Place>& inner = chains[getPrefixKey(ids, p + i)];
+				if (inner.size() == kMaxChain) inner.erase(inner.begin());
+				inner.push_back({ (uint32_t)s, (uint32_t)(p + i) });
+			}
+			p += bestCount;
+		}
+	}
+
+	return candidates;
+}
+
+// Greedy parse with the live candidates, longest in bytes first at each place
+static vector<vector<MacroUse>> parseMacroUses(const MacroInput& input, vector<MacroCandidate>& candidates,
+	const unordered_map<uint64_t, vector<uint32_t>>& byPrefix)
+{
+	vector<vector<MacroUse>> uses(input.shaderIds.size());
+	for (auto& candidate : candidates) candidate.uses = 0;
+
+	for (size_t s = 0; s < input.shaderIds.size(); ++s)
+	{
+		const vector<uint32_t>& ids = input.shaderIds[s];
+		size_t p = 0;
+		while (p + kMinRun <= ids.size())
+		{
+			auto it = byPrefix.find(getPrefixKey(ids, p));
+			size_t count = 1;
+			if (it != byPrefix.end())
+			{
+				for (uint32_t c : it->second)
+				{
+					MacroCandidate& candidate = candidates[c];
+					if (!candidate.bAlive || p + candidate.ids.size() > ids.size()) continue;
+					if (!equal(candidate.ids.begin(), candidate.ids.end(), ids.begin() + p)) continue;
+
+					candidate.uses++;
+					uses[s].push_back({ p, c });
+					count = candidate.ids.size();
+					break;
+				}
+			}
+			p += count;
+		}
+	}
+
+	return uses;
+}
+
+MacroDictionary buildInstructionMacros(vector<EncodedShader>& shaders, const vector<vector<size_t>>& instructionOffsets,
+	const OpRemapTable& remapTable)
+{
+	MacroDictionary macros;
+	const MacroInput input = buildMacroInput(shaders, instructionOffsets);
+
+	// Reference is the op/len word and the index, a second index byte past 128 entries
+	ByteArray reference;
+	writeMacroReference(reference, 0, remapTable);
+	size_t referenceBytes = reference.size();
+
+	vector<MacroCandidate> candidates = findMacroCandidates(input);
+	if (candidates.size() > 128) referenceBytes++;
+
+	unordered_map<uint64_t, vector<uint32_t>> byPrefix;
+	for (uint32_t c = 0; c < candidates.size(); ++c) byPrefix[getPrefixKey(candidates[c].ids, 0)].push_back(c);
+	for (auto& prefix : byPrefix)
+	{
+		stable_sort(prefix.second.begin(), prefix.second.end(), [&](uint32_t a, uint32_t b) { return candidates[a].bytes > candidates[b].bytes; });
+	}
+
+	// Runs that don't pay for their dictionary entry and offset are dropped, which frees their places
+	// for the others, until the parse settles
+	vector<vector<MacroUse>> uses;
+	for (int pass = 0; pass < kMaxPasses; ++pass)
+	{
+		uses = parseMacroUses(input, candidates, byPrefix);
+
+		bool bDropped = false;
+		for (auto& candidate : candidates)
+		{
+			if (!candidate.bAlive) continue;
+			const int64_t savings = (int64_t)candidate.uses * ((int64_t)candidate.bytes - (int64_t)referenceBytes) - (int64_t)(candidate.bytes + 4);
+			if (savings > 0) continue;
+			candidate.bAlive = false;
+			bDropped = true;
+		}
+		if (!bDropped) break;
+		if (pass + 1 == kMaxPasses) uses = parseMacroUses(input, candidates, byPrefix);
+	}
+
+	// Most used runs first, for the one byte indices
+	vector<uint32_t> order;
+	for (uint32_t c = 0; c < candidates.size(); ++c)
+	{
+		if (candidates[c].bAlive && candidates[c].uses > 0) order.push_back(c);
+	}
+	stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return candidates[a].uses > candidates[b].uses; });
+	if (order.empty()) return macros;
+
+	vector<uint32_t> indices(candidates.size());
+	for (uint32_t i = 0; i < order.size(); ++i)
+	{
+		indices[order[i]] = i;
+		macros.offsets.push_back((uint32_t)macros.bytes.size());
+		for (uint32_t id : candidates[order[i]].ids)
+		{
+			macros.bytes.insert(macros.bytes.end(), input.instructions[id].begin(), input.instructions[id].end());
+		}
+	}
+	macros.offsets.push_back((uint32_t)macros.bytes.size());
+
+	// Payloads again with the references, smol-v header as it was
+	for (size_t s = 0; s < shaders.size(); ++s)
+	{
+		if (instructionOffsets[s].empty()) continue;
+
+		const vector<uint32_t>& ids = input.shaderIds[s];
+		ByteArray smolv(shaders[s].smolv.begin(), shaders[s].smolv.begin() + instructionOffsets[s][0]);
+		size_t next = 0;
+		for (const MacroUse& use : uses[s])
+		{
+			for (; next < use.position; ++next) smolv.insert(smolv.end(), input.instructions[ids[next]].begin(), input.instructions[ids[next]].end());
+			writeMacroReference(smolv, indices[use.candidate], remapTable);
+			next += candidates[use.candidate].ids.size();
+			macros.referenceCount++;
+		}
+		for (; next < ids.size(); ++next) smolv.insert(smolv.end(), input.instructions[ids[next]].begin(), input.instructions[ids[next]].end());
+		shaders[s].smolv = std::move(smolv);
+	}
+
+	return macros;
+}
@@ -0,0 +1,30 @@
+﻿// crunchmacro.h - dictionary of instruction runs repeated across the payloads
+//
+// (c) 2025 Ossi Luoto
+
+#pragma once
+
+#include "crunchheader.h"
+#include "crunchencoder.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Encoded instruction runs stored once in shared_macros, entry i is the bytes from offsets[i] to
+// offsets[i + 1]
+struct MacroDictionary {
+	smolv::ByteArray bytes;
+	std::vector<uint32_t> offsets;
+	size_t referenceCount = 0;
+
+	size_t entryCount() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+};
+
+// Finds runs of instructions that encode to the same bytes in two or more places of the interleaved
+// payloads, and replaces them with kOpMacro references to one copy in the dictionary when that saves
+// bytes. Same bytes decode to the same instructions from the same decoder state, and the state is
+// the one before the reference: result deltas, relative IDs and splice cursors carry through the run,
+// so a run rebases to the IDs of each place. Instruction offsets are the crunchEncode output offsets
+// of each shader.
+MacroDictionary buildInstructionMacros(std::vector<EncodedShader>& shaders, const std::vector<std::vector<size_t>>& instructionOffsets,
+	const OpRemapTable& remapTable);
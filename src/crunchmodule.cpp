@@ -0,0 +1,372 @@
+﻿// crunchmodule.cpp - SPIR-V module parsing with the ID operands of each instruction
+//
+// (c) 2025 Ossi Luoto
+
+#include "crunchmodule.h"
+#include "crunchencoder.h"
+
+#include <algorithm>
+#include <string.h>
+#include <string>
+
+using namespace std;
+using namespace smolv;
+
+// Operand layouts: T result type, R result, i ID, l literal word, s literal string, m memory
+// operands (mask, then Aligned literal and MakePointerAvailable/Visible IDs), * repeats the previous
+// operand to the end. Parsing stops at the end of the instruction, which covers optional operands.
+struct OpLayoutRange {
+	uint16_t first;
+	uint16_t last;
+	const char* layout;
+};
+
+static const OpLayoutRange kOpLayouts[] =
+{
+	{ 1, 1, "TR" }, { 2, 2, "s" }, { 3, 3, "llis" }, { 4, 4, "s" }, { 5, 5, "is" }, { 6, 6, "ils" }, { 7, 7, "Rs" },
+	{ 8, 8, "ill" }, { 10, 10, "s" }, { 11, 11, "Rs" }, { 12, 12, "TRili*" }, { 14, 14, "ll" }, { 15, 15, "lisi*" },
+	{ 16, 16, "il*" }, { 17, 17, "l" }, { 19, 20, "R" }, { 21, 21, "Rll" }, { 22, 22, "Rl*" }, { 23, 24, "Ril" },
+	{ 25, 25, "Ril*" }, { 26, 26, "R" }, { 27, 27, "Ri" }, { 28, 28, "Rii" }, { 29, 29, "Ri" }, { 30, 30, "Ri*" },
+	{ 31, 31, "Rs" }, { 32, 32, "Rli" }, { 33, 33, "Ri*" }, { 34, 37, "R" }, { 38, 38, "Rl" },
+	{ 41, 42, "TR" }, { 43, 43, "TRl*" }, { 44, 44, "TRi*" }, { 45, 45, "TRlll" }, { 46, 46, "TR" },
+	{ 48, 49, "TR" }, { 50, 50, "TRl*" }, { 51, 51, "TRi*" },
+	{ 54, 54, "TRli" }, { 55, 55, "TR" }, { 56, 56, "" }, { 57, 57, "TRii*" }, { 59, 59, "TRli" }, { 60, 60, "TRiii" },
+	{ 61, 61, "TRim" }, { 62, 62, "iim" }, { 63, 63, "iimm" }, { 65, 66, "TRii*" }, { 67, 67, "TRiii*" },
+	{ 68, 68, "TRil" }, { 69, 69, "TRi" }, { 70, 70, "TRiii*" }, { 71, 71, "il*" }, { 72, 72, "ill*" },
+	{ 77, 77, "TRii" }, { 78, 78, "TRiii" }, { 79, 79, "TRiil*" }, { 80, 80, "TRi*" }, { 81, 81, "TRil*" },
+	{ 82, 82, "TRiil*" }, { 83, 84, "TRi" }, { 86, 86, "TRii" }, { 87, 88, "TRiili*" }, { 89, 90, "TRiiili*" },
+	{ 91, 92, "TRiili*" }, { 93, 94, "TRiiili*" }, { 95, 95, "TRiili*" }, { 96, 97, "TRiiili*" }, { 98, 98, "TRiili*" },
+	{ 99, 99, "iiili*" }, { 100, 102, "TRi" }, { 103, 103, "TRii" }, { 104, 104, "TRi" }, { 105, 105, "TRii" },
+	{ 106, 107, "TRi" }, { 109, 122, "TRi" }, { 123, 123, "TRil" }, { 124, 124, "TRi" }, { 126, 127, "TRi" },
+	{ 128, 152, "TRii" }, { 154, 160, "TRi" }, { 161, 167, "TRii" }, { 168, 168, "TRi" }, { 169, 169, "TRiii" },
+	{ 170, 191, "TRii" }, { 194, 199, "TRii" }, { 200, 200, "TRi" }, { 201, 201, "TRiiii" }, { 202, 203, "TRiii" },
+	{ 204, 205, "TRi" }, { 207, 215, "TRi" }, { 218, 219, "" }, { 220, 221, "i" }, { 224, 224, "iii" }, { 225, 225, "ii" },
+	{ 227, 227, "TRiii" }, { 228, 228, "iiii" }, { 229, 229, "TRiiii" }, { 230, 231, "TRiiiiii" }, { 232, 233, "TRiii" },
+	{ 234, 242, "TRiiii" }, { 245, 245, "TRi*" }, { 246, 246, "iil*" }, { 247, 247, "il" }, { 248, 248, "R" },
+	{ 249, 249, "i" }, { 250, 250, "iiil*" }, { 252, 253, "" }, { 254, 254, "i" }, { 255, 255, "" }, { 256, 257, "il" },
+	{ 317, 317, "" }, { 330, 330, "s" }, { 331, 332, "ili*" }, { 333, 333, "TRi" }, { 334, 336, "TRii" },
+	{ 337, 337, "TRiii" }, { 338, 340, "TRii" }, { 341, 341, "TRiii" }, { 342, 342, "TRili" }, { 343, 344, "TRii" },
+	{ 345, 348, "TRiii" }, { 349, 364, "TRili*" }, { 365, 366, "TRiii" }, { 400, 400, "TRi" }, { 401, 403, "TRii" },
+	{ 5632, 5632, "ils*" }, { 5633, 5633, "ills*" },	// OpDecorateString, OpMemberDecorateString
+};
+
+enum
+{
+	kOpString = 7,
+	kOpLine = 8,
+	kOpExtension = 10,
+	kOpExtInstImport = 11,
+	kOpMemoryModel = 14,
+	kOpEntryPoint = 15,
+	kOpExecutionMode = 16,
+	kOpCapability = 17,
+	kOpTypeInt = 21,
+	kOpFunction = 54,
+	kOpDecorate = 71,
+	kOpMemberDecorate = 72,
+	kOpSwitch = 251,
+	kOpNoLine = 317,
+	kOpModuleProcessed = 330,
+	kOpExecutionModeId = 331,
+	kOpDecorateId = 332,
+};
+
+static const char* findOpLayout(uint32_t op)
+{
+	for (const auto& range : kOpLayouts)
+	{
+		if (op >= range.first && op <= range.last) return range.layout;
+	}
+	return nullptr;
+}
+
+static uint8_t getSection(uint32_t op, bool bInFunctions)
+{
+	if (bInFunctions) return kSectionFunction;
+
+	switch (op)
+	{
+	case kOpCapability: return kSectionCapability;
+	case kOpExtension: return kSectionExtension;
+	case kOpExtInstImport: return kSectionExtInstImport;
+	case kOpMemoryModel: return kSectionMemoryModel;
+	case kOpEntryPoint: return kSectionEntryPoint;
+	case kOpExecutionMode: case kOpExecutionModeId: return kSectionExecutionMode;
+	case 2: case 3: case 4: case kOpString: return kSectionDebugString;
+	case 5: case 6: return kSectionDebugName;
+	case kOpModuleProcessed: return kSectionModuleProcessed;
+	case kOpDecorate: case kOpMemberDecorate: case kOpDecorateId: case 5632: case 5633: return kSectionAnnotation;
+	default: return kSectionDeclaration;
+	}
+}
+
+// Word count of a literal string starting at the word, the last word has the terminating zero
+static size_t getStringWords(const uint32_t* words, size_t available)
+{
+	for (size_t i = 0; i < available; ++i)
+	{
+		uint32_t w = words[i];
+		if ((w & 0xFF) == 0 || (w & 0xFF00) == 0 || (w & 0xFF0000) == 0 || (w & 0xFF000000) == 0) return i + 1;
+	}
+	return available;
+}
+
+static bool parseOperands(const uint32_t* words, uint32_t op, uint16_t length, const vector<uint8_t>& switchWidths, SpirvInstruction& instruction)
+{
+	instruction.resultType = -1;
+	instruction.result = -1;
+	instruction.idOperands.clear();
+
+	// Selector width decides the literal width of the cases
+	if (op == kOpSwitch)
+	{
+		if (length < 3) return false;
+		instruction.idOperands = { 1, 2 };
+		uint32_t selector = words[1];
+		size_t literalWords = selector < switchWidths.size() && switchWidths[selector] ? switchWidths[selector] : 1;
+		for (size_t i = 3; i < length; i += literalWords + 1)
+		{
+			if (i + literalWords >= length) return false;
+			instruction.idOperands.push_back((uint16_t)(i + literalWords));
+		}
+		return true;
+	}
+
+	string layoutText;
+	if (const char* layout = findOpLayout(op))
+	{
+		layoutText = layout;
+	}
+	else
+	{
+		// Extended ops, all operands are IDs
+		const char* name = getExtendedOpName(op);
+		if (!name) return false;
+		CrunchOpData data = getCrunchOpData(op, true);
+		if (data.hasType) layoutText += 'T';
+		if (data.hasResult) layoutText += 'R';
+		layoutText += "i*";
+	}
+
+	size_t w = 1;
+	for (size_t l = 0; l < layoutText.size() && w < length; ++l)
+	{
+		char kind = layoutText[l];
+		bool bRepeat = l + 1 < layoutText.size() && layoutText[l + 1] == '*';
+
+		do
+		{
+			switch (kind)
+			{
+			case 'T': instruction.resultType = (int16_t)w++; break;
+			case 'R': instruction.result = (int16_t)w++; break;
+			case 'i': instruction.idOperands.push_back((uint16_t)w++); break;
+			case 'l': w++; break;
+			case 's': w += getStringWords(words + w, length - w); break;
+			case 'm':
+			{
+				uint32_t mask = words[w++];
+				if ((mask & 0x2) && w < length) w++;											// Aligned
+				if ((mask & 0x8) && w < length) instruction.idOperands.push_back((uint16_t)w++);	// MakePointerAvailable
+				if ((mask & 0x10) && w < length) instruction.idOperands.push_back((uint16_t)w++);	// MakePointerVisible
+				break;
+			}
+			default: return false;
+			}
+		} while (bRepeat && w < length);
+
+		if (bRepeat) l++;
+	}
+
+	return w == length;
+}
+
+bool SpirvInstruction::isId(uint16_t w) const
+{
+	return w == result || w == resultType || find(idOperands.begin(), idOperands.end(), w) != idOperands.end();
+}
+
+bool parseSpirvModule(const ByteArray& spirv, SpirvModule& module)
+{
+	const size_t wordCount = spirv.size() / 4;
+	if (wordCount * 4 != spirv.size() || wordCount < 5) return false;
+
+	memcpy(module.header, spirv.data(), 5 * 4);
+	if (module.header[0] != 0x07230203) return false;
+
+	module.words.resize(wordCount - 5);
+	memcpy(module.words.data(), spirv.data() + 5 * 4, module.words.size() * 4);
+
+	return buildSpirvModule(module.header, module.words, module);
+}
+
+bool buildSpirvModule(const uint32_t header[5], const vector<uint32_t>& words, SpirvModule& module)
+{
+	if (&module.words != &words) module.words = words;
+	if (module.header != header) memcpy(module.header, header, 5 * 4);
+	module.instructions.clear();
+
+	const uint32_t bound = module.header[3];
+	vector<uint8_t> intWidths;		// by type ID, in words, for OpSwitch
+	vector<uint8_t> switchWidths;	// by value ID
+	bool bInFunctions = false;
+
+	for (size_t offset = 0; offset < module.words.size();)
+	{
+		const uint32_t* instructionWords = &module.words[offset];
+		uint16_t length = (uint16_t)(instructionWords[0] >> 16);
+		uint32_t op = instructionWords[0] & 0xFFFF;
+		if (length == 0 || offset + length > module.words.size()) return false;
+
+		// IDs that can't be renumbered or keyed safely
+		if (op == 39 || op == 52 || op == 73 || op == 74 || op == 75) return false;
+
+		if (op == kOpFunction) bInFunctions = true;
+
+		SpirvInstruction instruction;
+		instruction.offset = offset;
+		instruction.op = (uint16_t)op;
+		instruction.length = length;
+		instruction.section = getSection(op, bInFunctions);
+		if (!parseOperands(instructionWords, op, length, switchWidths, instruction)) return false;
+
+		// Every ID must be below the bound
+		if (instruction.resultType >= 0 && instructionWords[instruction.resultType] >= bound) return false;
+		if (instruction.result >= 0 && instructionWords[instruction.result] >= bound) return false;
+		for (uint16_t w : instruction.idOperands)
+		{
+			if (instructionWords[w] >= bound) return false;
+		}
+
+		// Track 64-bit integer values for the OpSwitch literals
+		if (op == kOpTypeInt && length >= 3)
+		{
+			if (intWidths.size() < bound) intWidths.resize(bound, 0);
+			intWidths[instructionWords[1]] = (uint8_t)((instructionWords[2] + 31) / 32);
+		}
+		if (instruction.resultType >= 0 && instruction.result >= 0)
+		{
+			uint32_t type = instructionWords[instruction.resultType];
+			if (type < intWidths.size() && intWidths[type])
+			{
+				if (switchWidths.size() < bound) switchWidths.resize(bound, 0);
+				switchWidths[instructionWords[instruction.result]] = intWidths[type];
+			}
+		}
+
+		module.instructions.push_back(std::move(instruction));
+		offset += length;
+	}
+
+	return true;
+}
+
+bool stripSpirvDebugInfo(SpirvModule& module)
+{
+	vector<uint32_t> words;
+	words.reserve(module.words.size());
+	for (const auto& instruction : module.instructions)
+	{
+		bool bDebug = instruction.section == kSectionDebugString || instruction.section == kSectionDebugName ||
+			instruction.section == kSectionModuleProcessed || instruction.op == kOpLine || instruction.op == kOpNoLine;
+		if (bDebug) continue;
+
+		const uint32_t* instructionWords = module.instructionWords(instruction);
+		words.insert(words.end(), instructionWords, instructionWords + instruction.length);
+	}
+	return buildSpirvModule(module.header, words, module);
+}
+
+bool renumberSpirvIds(SpirvModule& module)
+{
+	// OpString IDs last, the types referenced all over the module keep the low IDs
+	vector<uint32_t> idMap(module.header[3], 0);
+	uint32_t nextId = 1;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (const auto& instruction : module.instructions)
+		{
+			if (instruction.result < 0 || (instruction.section == kSectionDebugString) != (pass == 1)) continue;
+			uint32_t& id = idMap[module.instructionWords(instruction)[instruction.result]];
+			if (!id) id = nextId++;
+		}
+	}
+
+	for (const auto& instruction : module.instructions)
+	{
+		const uint32_t* words = module.instructionWords(instruction);
+		if (instruction.resultType >= 0 && !idMap[words[instruction.resultType]]) return false;
+		for (uint16_t w : instruction.idOperands)
+		{
+			if (!idMap[words[w]]) return false;
+		}
+	}
+
+	for (const auto& instruction : module.instructions)
+	{
+		uint32_t* words = module.instructionWords(instruction);
+		for (uint16_t w = 1; w < instruction.length; ++w)
+		{
+			if (instruction.isId(w)) words[w] = idMap[words[w]];
+		}
+	}
+	module.header[3] = nextId;
+
+	// Decorations in target order, smol-v codes their targets as deltas from the previous one
+	vector<const SpirvInstruction*> annotations;
+	for (const auto& instruction : module.instructions)
+	{
+		if (instruction.section == kSectionAnnotation) annotations.push_back(&instruction);
+	}
+	stable_sort(annotations.begin(), annotations.end(), [&](const SpirvInstruction* a, const SpirvInstruction* b) {
+		return module.instructionWords(*a)[1] < module.instructionWords(*b)[1];
+	});
+
+	vector<uint32_t> words;
+	words.reserve(module.words.size());
+	size_t nextAnnotation = 0;
+	for (const auto& instruction : module.instructions)
+	{
+		const SpirvInstruction& source = instruction.section == kSectionAnnotation ? *annotations[nextAnnotation++] : instruction;
+		const uint32_t* sourceWords = module.instructionWords(source);
+		words.insert(words.end(), sourceWords, sourceWords + source.length);
+	}
+	return buildSpirvModule(module.header, words, module);
+}
+
+ByteArray writeSpirvModule(const SpirvModule& module)
+{
+	ByteArray spirv((5 + module.words.size()) * 4);
+	memcpy(spirv.data(), module.header, 5 * 4);
+	memcpy(spirv.data() + 5 * 4, module.words.data(), module.words.size() * 4);
+	return spirv;
+}
+
+ByteArray writeSpirvModule(const uint32_t header[5], uint32_t bound, const vector<uint32_t>& words)
+{
+	SpirvModule module;
+	memcpy(module.header, header, 5 * 4);
+	module.header[3] = bound;
+	module.words = words;
+	return writeSpirvModule(module);
+}
+
+uint64_t mixKey(uint64_t key, uint64_t value)
+{
+	key ^= value + 0x9E3779B97F4A7C15ull + (key << 6) + (key >> 2);
+	return key * 0xFF51AFD7ED558CCDull;
+}
+
+int getSimilarity(const MinHashSignature& a, const MinHashSignature& b)
+{
+	int same = 0;
+	for (int k = 0; k < kMinHashes; ++k) same += a[k] == b[k];
+	return same;
+}
+
+uint64_t getBandKey(const MinHashSignature& signature, int band)
+{
+	uint64_t key = band;
+	for (int k = band * kBandSize; k < (band + 1) * kBandSize; ++k) key = key * 0x100000001B3ull ^ signature[k];
+	return key;
+}
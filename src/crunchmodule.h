@@ -0,0 +1,90 @@
+﻿// crunchmodule.h - SPIR-V module parsing with the ID operands of each instruction
+//
+// (c) 2025 Ossi Luoto
+
+#pragma once
+
+#include "smolv.h"
+
+#include <stdint.h>
+#include <array>
+#include <vector>
+
+// Logical layout sections of a module, in the order SPIR-V requires them
+enum SpirvSection
+{
+	kSectionCapability,
+	kSectionExtension,
+	kSectionExtInstImport,
+	kSectionMemoryModel,
+	kSectionEntryPoint,
+	kSectionExecutionMode,
+	kSectionDebugString,	// OpString, OpSource*
+	kSectionDebugName,		// OpName, OpMemberName
+	kSectionModuleProcessed,
+	kSectionAnnotation,
+	kSectionDeclaration,	// types, constants, global variables
+	kSectionFunction,
+	kSectionCount
+};
+
+struct SpirvInstruction {
+	size_t offset;			// first word in SpirvModule::words
+	uint16_t op;
+	uint16_t length;
+	uint8_t section;
+	int16_t resultType;		// word index within the instruction, -1 if none
+	int16_t result;
+	std::vector<uint16_t> idOperands;	// word indices of the referenced IDs
+
+	bool isId(uint16_t w) const;		// result, result type or ID operand
+};
+
+struct SpirvModule {
+	uint32_t header[5];
+	std::vector<uint32_t> words;	// instructions after the header
+	std::vector<SpirvInstruction> instructions;
+
+	const uint32_t* instructionWords(const SpirvInstruction& instruction) const { return &words[instruction.offset]; }
+	uint32_t* instructionWords(const SpirvInstruction& instruction) { return &words[instruction.offset]; }
+};
+
+// Parses the module and the ID operands of every instruction. Fails on malformed input and on ops
+// without a known operand layout, or ones that can't be renumbered (OpTypeForwardPointer,
+// decoration groups, OpSpecConstantOp), as the passes need every ID of the module.
+bool parseSpirvModule(const smolv::ByteArray& spirv, SpirvModule& module);
+
+// Removes the same debug instructions as kEncodeFlagStripDebugInfo, for passes that need the
+// stripped module before encoding
+bool stripSpirvDebugInfo(SpirvModule& module);
+
+// Renumbers the IDs from 1 in the order of their definitions, OpString last, and lowers the bound to
+// match, so that result deltas are small and alike. Decorations are sorted by target for the same
+// reason. Fails if an ID is used without a definition.
+bool renumberSpirvIds(SpirvModule& module);
+
+// Header and instruction words as SPIR-V binary
+smolv::ByteArray writeSpirvModule(const SpirvModule& module);
+
+// Same from header, bound and instruction words, for modules rebuilt by the passes
+smolv::ByteArray writeSpirvModule(const uint32_t header[5], uint32_t bound, const std::vector<uint32_t>& words);
+
+// Hash combine for structural keys of instructions and their operands
+uint64_t mixKey(uint64_t key, uint64_t value);
+
+// Shaders are compared by MinHash signatures of their instruction feature sets. Large sets look for
+// similar shaders in LSH buckets of signature bands, scanning the last few of each bucket.
+static const int kMinHashes = 32;
+static const int kBandSize = 4;
+static const size_t kBucketScanLimit = 64;
+
+using MinHashSignature = std::array<uint32_t, kMinHashes>;
+
+// Number of matching MinHashes, 0..kMinHashes
+int getSimilarity(const MinHashSignature& a, const MinHashSignature& b);
+
+// Bucket key of a band of kBandSize MinHashes, band 0..kMinHashes / kBandSize - 1
+uint64_t getBandKey(const MinHashSignature& signature, int band);
+
+// Module from header and instruction words, parsed again
+bool buildSpirvModule(const uint32_t header[5], const std::vector<uint32_t>& words, SpirvModule& module);
@@ -0,0 +1,135 @@
+﻿// crunchoptimize.cpp - light SPIR-V optimizer passes before encoding
+//
+// (c) 2025 Ossi Luoto
+
+#include "crunchoptimize.h"
+
+using namespace std;
+using namespace smolv;
+
+enum
+{
+	kOpEntryPoint = 15,
+	kOpFunction = 54,
+	kOpFunctionEnd = 56,
+	kOpDecorate = 71,
+	kDecorationSpecId = 1,
+	kDecorationBuiltIn = 11,
+	kBuiltInWorkgroupSize = 25,
+};
+
+bool eliminateDeadCode(SpirvModule& module, size_t& removedInstructions)
+{
+	removedInstructions = 0;
+	const auto& instructions = module.instructions;
+	const size_t count = instructions.size();
+
+	bool bHasEntryPoint = false;
+	for (const auto& instruction : instructions) bHasEntryPoint |= instruction.op == kOpEntryPoint;
+	if (!bHasEntryPoint) return false;
+
+	// Defining instruction of each ID and the span of each function
+	vector<int32_t> definitions(module.header[3], -1);
+	vector<int32_t> functionStarts(count, -1);
+	vector<size_t> functionEnds(count, 0);
+	int32_t function = -1;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const auto& instruction = instructions[i];
+		if (instruction.op == kOpFunction) function = (int32_t)i;
+		functionStarts[i] = function;
+		if (instruction.result >= 0) definitions[module.instructionWords(instruction)[instruction.result]] = (int32_t)i;
+		if (instruction.op == kOpFunctionEnd && function >= 0)
+		{
+			functionEnds[function] = i;
+			function = -1;
+		}
+	}
+
+	vector<bool> liveInstructions(count, false);
+	vector<bool> liveIds(module.header[3], false);
+	vector<uint32_t> pending;
+
+	auto markInstruction = [&](size_t i) {
+		if (liveInstructions[i]) return;
+		liveInstructions[i] = true;
+
+		const auto& instruction = instructions[i];
+		const uint32_t* words = module.instructionWords(instruction);
+		if (instruction.resultType >= 0) pending.push_back(words[instruction.resultType]);
+		for (uint16_t w : instruction.idOperands) pending.push_back(words[w]);
+	};
+
+	// A live function is live as a whole
+	auto markPending = [&]() {
+		while (!pending.empty())
+		{
+			uint32_t id = pending.back();
+			pending.pop_back();
+			if (liveIds[id]) continue;
+			liveIds[id] = true;
+
+			int32_t definition = definitions[id];
+			if (definition < 0) continue;
+			int32_t start = functionStarts[definition];
+			if (start < 0)
+			{
+				markInstruction(definition);
+				continue;
+			}
+			for (size_t i = start; i <= functionEnds[start]; ++i) markInstruction(i);
+		}
+	};
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const auto& instruction = instructions[i];
+		bool bConditional = instruction.section == kSectionAnnotation || instruction.section == kSectionDebugName ||
+			instruction.section == kSectionModuleProcessed || instruction.section == kSectionFunction;
+		if (!bConditional && instruction.result < 0) markInstruction(i);
+	}
+
+	// WorkgroupSize gives the local size with nothing referring to it, and SpecId constants are the
+	// specialization interface of the module, kept as spirv-opt keeps them even when unused
+	for (const auto& instruction : instructions)
+	{
+		if (instruction.op != kOpDecorate || instruction.length < 3) continue;
+		const uint32_t* words = module.instructionWords(instruction);
+		const bool bWorkgroupSize = words[2] == kDecorationBuiltIn && instruction.length >= 4 && words[3] == kBuiltInWorkgroupSize;
+		if (bWorkgroupSize || words[2] == kDecorationSpecId) pending.push_back(words[1]);
+	}
+	markPending();
+
+	// Decorations and names of live IDs, decorations with ID operands may bring in more
+	for (bool bChanged = true; bChanged;)
+	{
+		bChanged = false;
+		for (size_t i = 0; i < count; ++i)
+		{
+			const auto& instruction = instructions[i];
+			if (liveInstructions[i] || instruction.length < 2) continue;
+			if (instruction.section != kSectionAnnotation && instruction.section != kSectionDebugName) continue;
+			if (!liveIds[module.instructionWords(instruction)[1]]) continue;
+
+			markInstruction(i);
+			markPending();
+			bChanged = true;
+		}
+	}
+
+	vector<uint32_t> words;
+	words.reserve(module.words.size());
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (!liveInstructions[i])
+		{
+			removedInstructions++;
+			continue;
+		}
+		const uint32_t* instructionWords = module.instructionWords(instructions[i]);
+		words.insert(words.end(), instructionWords, instructionWords + instructions[i].length);
+	}
+
+	if (!removedInstructions) return true;
+	return buildSpirvModule(module.header, words, module);
+}
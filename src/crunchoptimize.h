@@ -0,0 +1,16 @@
+﻿// crunchoptimize.h - light SPIR-V optimizer passes before encoding
+//
+// (c) 2025 Ossi Luoto
+
+#pragma once
+
+#include "crunchmodule.h"
+
+#include <stddef.h>
+
+// Removes functions not reachable from the entry points, global declarations nothing live refers
+// to, decorations and names of the removed IDs and OpModuleProcessed. Liveness starts from the
+// capabilities, entry points, execution modes and the other instructions without a result, and the
+// IDs decorated BuiltIn WorkgroupSize or SpecId. Modules without an entry point (libraries) are left
+// as they are.
+bool eliminateDeadCode(SpirvModule& module, size_t& removedInstructions);
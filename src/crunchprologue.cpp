@@ -0,0 +1,265 @@
+﻿// crunchprologue.cpp - shared prologue of the declarations common to the input shaders
+//
+// (c) 2025 Ossi Luoto
+
+#include "crunchprologue.h"
+#include "crunchmodule.h"
+#include "crunchencoder.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+using namespace smolv;
+
+struct PrologueShader {
+	size_t index;				// in the input shaders
+	SpirvModule module;
+	vector<uint64_t> keys;		// by instruction, 0 if not shareable
+	vector<uint32_t> idMap;		// canonical IDs
+};
+
+struct PrologueEntry {
+	uint8_t section;
+	size_t shader;				// first seen in, in the parsed shaders
+	size_t instruction;
+	uint32_t shaderCount;
+	size_t lastShader;
+	uint32_t id;				// canonical result ID, 0 if none
+	size_t position;			// instruction index in the prologue
+	size_t offset;				// first word in the prologue
+};
+
+static bool isPrologueSection(uint8_t section)
+{
+	return section <= kSectionMemoryModel || section == kSectionAnnotation || section == kSectionDeclaration;
+}
+
+// Structural key of each declaration: op and operands, with the keys of the referenced IDs in place
+// of the IDs. Repeats of the same key in one shader are told apart by their occurrence.
+static bool keyDeclarations(PrologueShader& shader)
+{
+	const SpirvModule& module = shader.module;
+	vector<uint64_t> idKeys(module.header[3], 0);
+	vector<bool> defined(module.header[3], false);
+	unordered_map<uint64_t, uint32_t> occurrences;
+	shader.keys.assign(module.instructions.size(), 0);
+
+	// Renumbering needs every referenced ID defined in the module
+	for (const auto& instruction : module.instructions)
+	{
+		if (instruction.result >= 0) defined[module.instructionWords(instruction)[instruction.result]] = true;
+	}
+	for (const auto& instruction : module.instructions)
+	{
+		const uint32_t* words = module.instructionWords(instruction);
+		if (instruction.resultType >= 0 && !defined[words[instruction.resultType]]) return false;
+		for (uint16_t w : instruction.idOperands)
+		{
+			if (!defined[words[w]]) return false;
+		}
+	}
+
+	// Decorations come before their targets in the module, so they are keyed last
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (size_t i = 0; i < module.instructions.size(); ++i)
+		{
+			const auto& instruction = module.instructions[i];
+			if (!isPrologueSection(instruction.section)) continue;
+			if ((instruction.section == kSectionAnnotation) != (pass == 1)) continue;
+
+			const uint32_t* words = module.instructionWords(instruction);
+			uint64_t key = mixKey(instruction.op, instruction.length);
+			bool bShareable = true;
+			for (uint16_t w = 1; w < instruction.length && bShareable; ++w)
+			{
+				if (w == instruction.result) continue;
+
+				uint64_t value = words[w];
+				if (instruction.isId(w))
+				{
+					value = idKeys[words[w]];
+					bShareable = value != 0;
+				}
+				key = mixKey(key, value);
+			}
+			if (!bShareable) continue;
+
+			key = mixKey(key, occurrences[key]++);
+			if (key == 0) key = 1;
+			shader.keys[i] = key;
+			if (instruction.result >= 0) idKeys[words[instruction.result]] = key;
+		}
+	}
+	return true;
+}
+
+static void appendInstruction(vector<uint32_t>& output, const SpirvModule& module, const SpirvInstruction& instruction, const vector<uint32_t>& idMap)
+{
+	const uint32_t* words = module.instructionWords(instruction);
+	size_t start = output.size();
+	output.insert(output.end(), words, words + instruction.length);
+
+	if (instruction.resultType >= 0) output[start + instruction.resultType] = idMap[words[instruction.resultType]];
+	if (instruction.result >= 0) output[start + instruction.result] = idMap[words[instruction.result]];
+	for (uint16_t w : instruction.idOperands) output[start + w] = idMap[words[w]];
+}
+
+bool extractSharedPrologue(vector<EncodedShader>& shaders, SharedPrologue& prologue, bool bStripDebugInfo)
+{
+	prologue = SharedPrologue();
+
+	vector<PrologueShader> parsed;
+	for (size_t s = 0; s < shaders.size(); ++s)
+	{
+		PrologueShader shader;
+		shader.index = s;
+		if (!parseSpirvModule(shaders[s].spirv, shader.module)) continue;
+		if (bStripDebugInfo && !stripSpirvDebugInfo(shader.module)) continue;
+		if (!keyDeclarations(shader)) continue;
+		parsed.push_back(std::move(shader));
+	}
+
+	// Entries in the order first seen, which keeps each declaration after the ones it uses
+	vector<PrologueEntry> entries;
+	unordered_map<uint64_t, size_t> entryIndex;
+	for (size_t s = 0; s < parsed.size(); ++s)
+	{
+		const auto& shader = parsed[s];
+		for (size_t i = 0; i < shader.keys.size(); ++i)
+		{
+			if (!shader.keys[i]) continue;
+
+			auto found = entryIndex.find(shader.keys[i]);
+			if (found == entryIndex.end())
+			{
+				entryIndex[shader.keys[i]] = entries.size();
+				entries.push_back({ shader.module.instructions[i].section, s, i, 1, s, 0, 0, 0 });
+			}
+			else if (entries[found->second].lastShader != s)
+			{
+				entries[found->second].shaderCount++;
+				entries[found->second].lastShader = s;
+			}
+		}
+	}
+
+	// Entries of two or more shaders are shared, by section and canonical IDs from 1 in prologue order
+	auto getSharedEntry = [&](const PrologueShader& shader, size_t i) -> PrologueEntry* {
+		if (!shader.keys[i]) return nullptr;
+		PrologueEntry& entry = entries[entryIndex[shader.keys[i]]];
+		return entry.shaderCount >= 2 ? &entry : nullptr;
+	};
+
+	vector<size_t> sharedEntries;
+	for (size_t e = 0; e < entries.size(); ++e)
+	{
+		if (entries[e].shaderCount >= 2) sharedEntries.push_back(e);
+	}
+	stable_sort(sharedEntries.begin(), sharedEntries.end(), [&](size_t a, size_t b) { return entries[a].section < entries[b].section; });
+
+	uint32_t sharedIds = 0;
+	for (size_t p = 0; p < sharedEntries.size(); ++p)
+	{
+		PrologueEntry& entry = entries[sharedEntries[p]];
+		entry.position = p;
+		if (parsed[entry.shader].module.instructions[entry.instruction].result >= 0) entry.id = ++sharedIds;
+	}
+
+	// Shared IDs, then the shader's own IDs in definition order
+	for (auto& shader : parsed)
+	{
+		const SpirvModule& module = shader.module;
+		shader.idMap.assign(module.header[3], 0);
+		for (size_t i = 0; i < module.instructions.size(); ++i)
+		{
+			const auto& instruction = module.instructions[i];
+			PrologueEntry* entry = getSharedEntry(shader, i);
+			if (entry && entry->id) shader.idMap[module.instructionWords(instruction)[instruction.result]] = entry->id;
+		}
+
+		uint32_t nextId = sharedIds + 1;
+		for (const auto& instruction : module.instructions)
+		{
+			if (instruction.result < 0) continue;
+			uint32_t& id = shader.idMap[module.instructionWords(instruction)[instruction.result]];
+			if (!id) id = nextId++;
+		}
+	}
+
+	for (size_t e : sharedEntries)
+	{
+		PrologueEntry& entry = entries[e];
+		const PrologueShader& shader = parsed[entry.shader];
+		entry.offset = prologue.words.size();
+		appendInstruction(prologue.words, shader.module, shader.module.instructions[entry.instruction], shader.idMap);
+	}
+	prologue.instructionCount = sharedEntries.size();
+
+	// Canonical module and the payload module with splices, section by section
+	for (auto& shader : parsed)
+	{
+		const SpirvModule& module = shader.module;
+		vector<uint32_t> canonical, payload;
+		size_t cursor = 0;	// prologue instructions the decrunch cursor has passed
+		uint32_t bound = sharedIds + 1;
+		for (uint32_t id : shader.idMap) bound = max(bound, id + 1);
+
+		for (uint8_t section = 0; section < kSectionCount; ++section)
+		{
+			vector<const PrologueEntry*> used;
+			for (size_t i = 0; i < module.instructions.size(); ++i)
+			{
+				if (module.instructions[i].section != section) continue;
+				const PrologueEntry* entry = getSharedEntry(shader, i);
+				if (!entry) continue;
+
+				// Same key must give the same canonical words in every shader
+				vector<uint32_t> words;
+				appendInstruction(words, module, module.instructions[i], shader.idMap);
+				if (!equal(words.begin(), words.end(), prologue.words.begin() + entry->offset)) return false;
+				used.push_back(entry);
+			}
+			sort(used.begin(), used.end(), [](const PrologueEntry* a, const PrologueEntry* b) { return a->position < b->position; });
+
+			if (!used.empty())
+			{
+				size_t spliceStart = payload.size();
+				payload.push_back(kOpSharedPrologue);
+				for (size_t u = 0; u < used.size();)
+				{
+					size_t first = used[u]->position;
+					size_t take = 1;
+					while (u + take < used.size() && used[u + take]->position == first + take) take++;
+
+					payload.push_back((uint32_t)(first - cursor));
+					payload.push_back((uint32_t)take);
+					cursor = first + take;
+					u += take;
+				}
+				if (payload.size() - spliceStart > 0xFFFF) return false;
+				payload[spliceStart] |= (uint32_t)(payload.size() - spliceStart) << 16;
+
+				for (const PrologueEntry* entry : used)
+				{
+					const uint32_t* words = prologue.words.data() + entry->offset;
+					canonical.insert(canonical.end(), words, words + (words[0] >> 16));
+				}
+			}
+
+			for (size_t i = 0; i < module.instructions.size(); ++i)
+			{
+				const auto& instruction = module.instructions[i];
+				if (instruction.section != section || getSharedEntry(shader, i)) continue;
+				appendInstruction(canonical, module, instruction, shader.idMap);
+				appendInstruction(payload, module, instruction, shader.idMap);
+			}
+		}
+
+		shaders[shader.index].spirv = writeSpirvModule(module.header, bound, canonical);
+		shaders[shader.index].payloadSpirv = writeSpirvModule(module.header, bound, payload);
+	}
+
+	return true;
+}
@@ -0,0 +1,25 @@
+﻿// crunchprologue.h - shared prologue of the declarations common to the input shaders
+//
+// (c) 2025 Ossi Luoto
+
+#pragma once
+
+#include "crunchheader.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Capabilities, imports, memory model, types, constants, global variables and their decorations
+// that are in two or more shaders, stored once as instructions with canonical IDs
+struct SharedPrologue {
+	std::vector<uint32_t> words;
+	size_t instructionCount = 0;
+};
+
+// Canonicalizes the IDs of the shaders so that a shared declaration has the same ID in every
+// shader: shared IDs first in prologue order, then the shader's own IDs in definition order.
+// Spirv of each shader becomes the canonical module decrunch writes and payloadSpirv the module to
+// encode, with a kOpSharedPrologue splice in place of the shared declarations of each section.
+// Shaders that can't be parsed are left as they are. Debug info is stripped here if requested, as
+// the encoder can't strip it from the canonical module afterwards.
+bool extractSharedPrologue(std::vector<EncodedShader>& shaders, SharedPrologue& prologue, bool bStripDebugInfo);
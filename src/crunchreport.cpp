@@ -0,0 +1,205 @@
+﻿// crunchreport.cpp - phase timings, per shader rows and memory report
+//
+// (c) 2025 Ossi Luoto
+
+#include "crunchreport.h"
+
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+void CrunchReport::addPhase(const string& name, CrunchClock::time_point start)
+{
+	double ms = elapsedUs(start) / 1000.0;
+	for (auto& phase : phases)
+	{
+		if (phase.name == name)
+		{
+			phase.ms += ms;
+			return;
+		}
+	}
+	phases.push_back({ name, ms });
+}
+
+double CrunchReport::totalMs() const
+{
+	double total = 0.0;
+	for (const auto& phase : phases) total += phase.ms;
+	return total;
+}
+
+double elapsedUs(CrunchClock::time_point start)
+{
+	return chrono::duration<double, micro>(CrunchClock::now() - start).count();
+}
+
+size_t getPeakRss()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return counters.PeakWorkingSetSize;
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return (size_t)usage.ru_maxrss; // bytes
+#else
+	return (size_t)usage.ru_maxrss * 1024; // kilobytes
+#endif
+#endif
+}
+
+static double getRatio(size_t packed, size_t original)
+{
+	return original ? (double)packed / (double)original : 0.0;
+}
+
+void writeEstimate(ostream& output, const CrunchReport& report)
+{
+	output << std::fixed << std::setprecision(1);
+
+	output << "Packed size estimate (bytes):\n";
+	output << "  " << std::left << std::setw(24) << "name" << std::right << std::setw(10) << "smolv" << std::setw(10) << "packed" << std::setw(8) << "ratio" << "\n";
+	for (const auto& shader : report.shaders)
+	{
+		output << "  " << std::left << std::setw(24) << shader.name << std::right << std::setw(10) << shader.smolvBytes
+			<< std::setw(10) << shader.packedBytes << std::setw(8) << std::setprecision(3) << (shader.smolvBytes ? shader.packedBytes / shader.smolvBytes : 0.0)
+			<< std::setprecision(1) << "\n";
+	}
+	if (report.prologueBytes)
+	{
+		output << "  " << std::left << std::setw(24) << "shared prologue" << std::right << std::setw(10) << report.prologueBytes
+			<< std::setw(10) << report.packedPrologueBytes << std::setw(8) << std::setprecision(3) << report.packedPrologueBytes / report.prologueBytes
+			<< std::setprecision(1) << "\n";
+	}
+	if (report.stringTableBytes)
+	{
+		output << "  " << std::left << std::setw(24) << "shared strings" << std::right << std::setw(10) << report.stringTableBytes
+			<< std::setw(10) << report.packedStringTableBytes << std::setw(8) << std::setprecision(3) << report.packedStringTableBytes / report.stringTableBytes
+			<< std::setprecision(1) << "\n";
+	}
+	if (report.macroBytes)
+	{
+		output << "  " << std::left << std::setw(24) << "shared macros" << std::right << std::setw(10) << report.macroBytes
+			<< std::setw(10) << report.packedMacroBytes << std::setw(8) << std::setprecision(3) << report.packedMacroBytes / report.macroBytes
+			<< std::setprecision(1) << "\n";
+	}
+	output << "  " << std::left << std::setw(24) << "payload" << std::right << std::setw(20) << report.packedPayloadBytes << "\n";
+	if (report.packedInputOrderBytes > 0.0)
+	{
+		output << "  " << std::left << std::setw(24) << "payload in input order" << std::right << std::setw(20) << report.packedInputOrderBytes << "\n";
+	}
+	output << "  " << std::left << std::setw(24) << "decoder source text" << std::right << std::setw(20) << report.packedDecoderBytes << "\n";
+	output << std::defaultfloat << std::setprecision(6);
+}
+
+void writeTimings(ostream& output, const CrunchReport& report)
+{
+	output << std::fixed << std::setprecision(3);
+
+	output << "Phase timings (ms):\n";
+	for (const auto& phase : report.phases)
+	{
+		output << "  " << std::left << std::setw(16) << phase.name << std::right << std::setw(12) << phase.ms << "\n";
+	}
+	output << "  " << std::left << std::setw(16) << "total" << std::right << std::setw(12) << report.totalMs() << "\n";
+
+	output << "Shaders:\n";
+	output << "  " << std::left << std::setw(24) << "name" << std::right << std::setw(10) << "spirv" << std::setw(10) << "smolv"
+		<< std::setw(8) << "ratio" << std::setw(10) << "bound" << std::setw(14) << "encode us" << std::setw(14) << "analyze us" << "\n";
+	for (const auto& shader : report.shaders)
+	{
+		output << "  " << std::left << std::setw(24) << shader.name << std::right << std::setw(10) << shader.spirvBytes
+			<< std::setw(10) << shader.smolvBytes << std::setw(8) << std::setprecision(3) << getRatio(shader.smolvBytes, shader.spirvBytes)
+			<< std::setw(10) << shader.bound << std::setw(14) << std::setprecision(1) << shader.encodeUs
+			<< std::setw(14) << shader.analyzeUs << "\n";
+	}
+
+	output << "Peak RSS: " << getPeakRss() / 1024 << " KB\n";
+	output << std::defaultfloat << std::setprecision(6);
+}
+
+static string jsonString(const string& text)
+{
+	ostringstream result;
+	result << "\"";
+	for (unsigned char c : text)
+	{
+		if (c == '"' || c == '\\') result << '\\' << c;
+		else if (c < 0x20) result << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec << std::setfill(' ');
+		else result << c;
+	}
+	result << "\"";
+	return result.str();
+}
+
+void writeReportJson(ostream& output, const CrunchReport& report)
+{
+	size_t spirvBytes = 0, smolvBytes = 0;
+	for (const auto& shader : report.shaders)
+	{
+		spirvBytes += shader.spirvBytes;
+		smolvBytes += shader.smolvBytes;
+	}
+
+	output << std::fixed << std::setprecision(3);
+	output << "{\n";
+
+	output << "  \"phases\": {";
+	for (size_t i = 0; i < report.phases.size(); ++i)
+	{
+		output << (i ? ", " : " ") << jsonString(report.phases[i].name + "_ms") << ": " << report.phases[i].ms;
+	}
+	output << " },\n";
+
+	output << "  \"shaders\": [\n";
+	for (size_t i = 0; i < report.shaders.size(); ++i)
+	{
+		const auto& shader = report.shaders[i];
+		output << "    { \"name\": " << jsonString(shader.name)
+			<< ", \"spirv_bytes\": " << shader.spirvBytes
+			<< ", \"smolv_bytes\": " << shader.smolvBytes
+			<< ", \"ratio\": " << getRatio(shader.smolvBytes, shader.spirvBytes)
+			<< ", \"bound\": " << shader.bound
+			<< ", \"encode_us\": " << shader.encodeUs
+			<< ", \"analyze_us\": " << shader.analyzeUs;
+		if (report.bEstimate) output << ", \"packed_bytes\": " << shader.packedBytes;
+		output << " }" << (i + 1 < report.shaders.size() ? ",\n" : "\n");
+	}
+	output << "  ],\n";
+
+	output << "  \"totals\": { \"shaders\": " << report.shaders.size()
+		<< ", \"spirv_bytes\": " << spirvBytes
+		<< ", \"smolv_bytes\": " << smolvBytes
+		<< ", \"ratio\": " << getRatio(smolvBytes, spirvBytes)
+		<< ", \"decoder_bytes\": " << report.decoderBytes
+		<< ", \"prologue_bytes\": " << report.prologueBytes
+		<< ", \"string_table_bytes\": " << report.stringTableBytes
+		<< ", \"macro_bytes\": " << report.macroBytes
+		<< ", \"header_bytes\": " << report.headerBytes
+		<< ", \"wall_ms\": " << report.totalMs()
+		<< ", \"peak_rss_bytes\": " << getPeakRss();
+	if (report.bEstimate)
+	{
+		output << ", \"packed_payload_bytes\": " << report.packedPayloadBytes
+			<< ", \"packed_decoder_bytes\": " << report.packedDecoderBytes
+			<< ", \"packed_prologue_bytes\": " << report.packedPrologueBytes
+			<< ", \"packed_string_table_bytes\": " << report.packedStringTableBytes
+			<< ", \"packed_macro_bytes\": " << report.packedMacroBytes;
+		if (report.packedInputOrderBytes > 0.0) output << ", \"packed_input_order_bytes\": " << report.packedInputOrderBytes;
+	}
+	output << " }\n";
+
+	output << "}\n";
+	output << std::defaultfloat << std::setprecision(6);
+}
@@ -0,0 +1,59 @@
+﻿// crunchreport.h - phase timings, per shader rows and memory report
+//
+// (c) 2025 Ossi Luoto
+
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <ostream>
+
+using CrunchClock = std::chrono::steady_clock;
+
+struct CrunchPhase {
+	std::string name;
+	double ms;
+};
+
+struct CrunchShaderRow {
+	std::string name;
+	size_t spirvBytes;
+	size_t smolvBytes;		// payload in the header, without smol-v header
+	uint32_t bound;
+	double encodeUs;
+	double analyzeUs;
+	double packedBytes = 0.0;	// packed size estimate of the payload, with bEstimate
+};
+
+struct CrunchReport {
+	std::vector<CrunchPhase> phases;
+	std::vector<CrunchShaderRow> shaders;
+	size_t decoderBytes = 0;	// decrunch text
+	size_t headerBytes = 0;		// whole output header
+	bool bEstimate = false;
+	double packedPayloadBytes = 0.0;
+	double packedDecoderBytes = 0.0;
+	double packedInputOrderBytes = 0.0;	// payload estimate before --order, 0 if not reordered
+	size_t prologueBytes = 0;			// shared prologue in the .smolv section
+	double packedPrologueBytes = 0.0;
+	size_t stringTableBytes = 0;		// shared strings in the .smolv section
+	double packedStringTableBytes = 0.0;
+	size_t macroBytes = 0;				// macro dictionary runs and offsets in the .smolv section
+	double packedMacroBytes = 0.0;
+
+	// Adds the time since start to the phase, phases are kept in order of first use
+	void addPhase(const std::string& name, CrunchClock::time_point start);
+	double totalMs() const;
+};
+
+double elapsedUs(CrunchClock::time_point start);
+
+// Peak resident set size of the process in bytes, 0 if not available
+size_t getPeakRss();
+
+// Per shader and total packed size estimates
+void writeEstimate(std::ostream& output, const CrunchReport& report);
+void writeTimings(std::ostream& output, const CrunchReport& report);
+void writeReportJson(std::ostream& output, const CrunchReport& report);
@@ -0,0 +1,823 @@
+﻿// crunchtemplate.cpp - specialized decrunch generation from the precompiled template
+//
+// (c) 2025 Ossi Luoto
+
+#include "crunchtemplate.h"
+
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+#include <filesystem>
+
+#include "generated_shadertemplate.h"
+
+using namespace std;
+using namespace smolv;
+namespace fs = std::filesystem;
+
+AnalysisLookup buildAnalysisLookup(const DecodeAnalysis& analysis)
+{
+	AnalysisLookup lookup;
+
+	for (const auto& block : analysis.Blocks)
+	{
+		lookup.blocks.insert(block.entry);
+	}
+
+	for (const auto& op : analysis.SpvOps)
+	{
+		char* end = nullptr;
+		unsigned long opIndex = strtoul(op.entry.c_str(), &end, 10);
+		if (end != op.entry.c_str() && opIndex < lookup.spvOps.size()) lookup.spvOps.set(opIndex);
+	}
+
+	return lookup;
+}
+
+void mergeAnalysis(DecodeAnalysis& globalAnalysis, const DecodeAnalysis& localAnalysis)
+{
+	// Merge local blocks into global
+	for (const auto& block : localAnalysis.Blocks) {
+		bool found = false;
+		for (auto& gBlock : globalAnalysis.Blocks) {
+			if (gBlock.entry == block.entry) { gBlock.count += block.count; found = true; break; }
+		}
+		if (!found) globalAnalysis.Blocks.push_back(block);
+	}
+
+	// Merge local ops into global
+	for (const auto& op : localAnalysis.SpvOps) {
+		bool found = false;
+		for (auto& gOp : globalAnalysis.SpvOps) {
+			if (gOp.entry == op.entry) { gOp.count += op.count; found = true; break; }
+		}
+		if (!found) globalAnalysis.SpvOps.push_back(op);
+	}
+}
+
+static bool checkEntryFromBlocks(const AnalysisLookup& lookup, const char* tag)
+{
+	return lookup.blocks.count(tag) != 0;
+}
+
+static bool checkEntryFromSpv(const AnalysisLookup& lookup, int spvOp)
+{
+	return spvOp >= 0 && (size_t)spvOp < lookup.spvOps.size() && lookup.spvOps.test(spvOp);
+}
+
+// Option segments are included by the generation options only, not by the analysis
+static bool checkOption(const DecoderSpec& spec, const char* tag)
+{
+	string_view option(tag);
+	if (option == "Instrument") return spec.bInstrument;
+	if (option == "SharedPrologue") return spec.bSharedPrologue;
+	if (option == "Variants") return spec.bVariants;
+	if (option == "StringTable") return spec.bStringTable;
+	if (option == "ConstantLiterals") return spec.bConstantLiterals;
+	if (option == "CompactOps") return spec.bCompactOps;
+	if (option == "GroupVarint") return spec.bGroupVarint;
+	if (option == "HuffmanOps") return spec.remapTable.hasHuffmanOps();
+	if (option == "Macros") return spec.bMacros;
+	return false;
+}
+
+static void writeRemapTable(ostream& outputFile, const OpRemapTable& remapTable)
+{
+	for (const auto& swap : remapTable.swaps)
+	{
+		outputFile << "\t_SMOLV_SWAP_OP((SpvOp)" << swap.op << ", (SpvOp)" << swap.code << "); // " << swap.code << ": "
+			<< std::fixed << std::setprecision(1) << swap.share << "%\n";
+	}
+	outputFile << std::defaultfloat << std::setprecision(6);
+}
+
+// --------------------------------------------------------------------------------------------
+// Op data table emission
+
+// Packed op data: bit 0 hasResult, bit 1 hasType, bit 2 varrest, bits 4-7 deltaFromResult (max 11)
+static unsigned packOpData(const CrunchOpData& data)
+{
+	return (data.hasResult & 1) | ((data.hasType & 1) << 1) | ((data.varrest & 1) << 2) | ((data.deltaFromResult & 0xF) << 4);
+}
+
+static CrunchOpData getSegmentOpData(const TemplateSegment& segment)
+{
+	return { segment.opData[0], segment.opData[1], segment.opData[2], segment.opData[3] };
+}
+
+// Op name comment of the template line
+static string_view getSegmentComment(const TemplateSegment& segment)
+{
+	string_view name;
+	size_t comment = segment.text.find("//");
+	if (comment != string_view::npos)
+	{
+		name = segment.text.substr(comment);
+		while (!name.empty() && name.back() == '\n') name.remove_suffix(1);
+	}
+	return name;
+}
+
+static const TemplateSegment* findSpvSegment(uint32_t op)
+{
+	for (const auto& segment : shadertemplateSegments)
+	{
+		if (segment.kind == TemplateSegmentKind::Spv && segment.op == (int)op) return &segment;
+	}
+	return nullptr;
+}
+
+static void writeOpDataRow(ostream& outputFile, const CrunchOpData& data, bool bPacked, string_view comment)
+{
+	if (bPacked)
+	{
+		outputFile << "		0x" << std::hex << std::setw(2) << std::setfill('0') << packOpData(data)
+			<< std::dec << std::setfill(' ') << ", " << comment << "\n";
+	}
+	else
+	{
+		outputFile << "		{" << (int)data.hasResult << ", " << (int)data.hasType << ", " << (int)data.deltaFromResult
+			<< ", " << (int)data.varrest << "}, " << comment << "\n";
+	}
+}
+
+// Dense table has rows only for the ops in use, in op code order of the stream. Metadata comes
+// from the encoder, so that extended ops decode the same way they were encoded.
+static void writeDenseOpData(ostream& outputFile, const DecoderSpec& spec)
+{
+	for (uint16_t op : spec.remapTable.denseOps)
+	{
+		string comment;
+		const TemplateSegment* segment = findSpvSegment(op);
+		if (segment)
+		{
+			comment = string(getSegmentComment(*segment));
+		}
+		else
+		{
+			const char* name = getExtendedOpName(op);
+			comment = "// " + (name ? string(name) : "#" + to_string(op));
+		}
+		writeOpDataRow(outputFile, getCrunchOpData(op, true), spec.bPackedOpData, comment);
+	}
+}
+
+static void writeDenseOps(ostream& outputFile, const DecoderSpec& spec)
+{
+	const auto& denseOps = spec.remapTable.denseOps;
+
+	outputFile << "// Op of each op code in the stream\n";
+	outputFile << "static const SpvOp kSpirvDenseOps[] =\n{\n";
+	for (size_t i = 0; i < denseOps.size(); ++i)
+	{
+		if (i % 16 == 0) outputFile << "\t";
+		outputFile << denseOps[i] << ",";
+		outputFile << ((i % 16 == 15 || i + 1 == denseOps.size()) ? "\n" : " ");
+	}
+	outputFile << "};\n";
+
+	if (spec.remapTable.hasFixedLengths())
+	{
+		const auto& fixedLengths = spec.remapTable.fixedLengths;
+
+		outputFile << "// Fixed length ops are the last ones, coded by the low nibbles from kVariableNibbles up\n";
+		outputFile << "static const uint32_t kVariableNibbles = " << spec.remapTable.variableNibbles << ";\n";
+		outputFile << "static const uint32_t kVariableOps = " << spec.remapTable.variableOpCount() << ";\n";
+		outputFile << "static const uint8_t kFixedLengths[] =\n{\n";
+		for (size_t i = 0; i < fixedLengths.size(); ++i)
+		{
+			if (i % 16 == 0) outputFile << "\t";
+			outputFile << (uint32_t)fixedLengths[i] << ",";
+			outputFile << ((i % 16 == 15 || i + 1 == fixedLengths.size()) ? "\n" : " ");
+		}
+		outputFile << "};\n";
+	}
+
+	if (spec.remapTable.hasHuffmanOps())
+	{
+		const auto& lengthCounts = spec.remapTable.huffmanLengthCounts;
+
+		outputFile << "// Number of Huffman op codes of each bit length from 1 up\n";
+		outputFile << "static const uint16_t kHuffmanLengthCounts[] = { ";
+		for (size_t i = 0; i < lengthCounts.size(); ++i) outputFile << lengthCounts[i] << (i + 1 < lengthCounts.size() ? ", " : " };\n");
+	}
+}
+
+// Write replacement for a Replace segment, returns false to keep the template text
+static bool writeReplacement(ostream& outputFile, const DecoderSpec& spec, const char* tag)
+{
+	string_view replaceTag(tag);
+	const bool bDense = spec.remapTable.isDense();
+
+	if (replaceTag == "OpDataDeclaration" && (bDense || spec.bPackedOpData))
+	{
+		if (bDense) writeDenseOps(outputFile, spec);
+
+		if (spec.bPackedOpData)
+		{
+			outputFile << "// bit 0 hasResult, bit 1 hasType, bit 2 varrest, bits 4-7 deltaFromResult\n";
+			outputFile << "static const uint8_t kSpirvOpData[] =\n";
+		}
+		else
+		{
+			outputFile << "static const OpData kSpirvOpData[] =\n";
+		}
+		return true;
+	}
+
+	if (replaceTag == "OpLenSplit" && spec.remapTable.hasFixedLengths())
+	{
+		outputFile << "		const uint32_t opNibble = instrLen & 0xF;\n";
+		outputFile << "		const bool bFixedLength = opNibble >= kVariableNibbles;\n";
+		outputFile << "		op = (SpvOp)(bFixedLength ? kVariableOps + opNibble - kVariableNibbles + (16 - kVariableNibbles) * (instrLen >> 4) : opNibble + kVariableNibbles * ((instrLen >> 8) & 0xFFF));\n";
+		outputFile << "		instrLen = ((instrLen >> 20) << 4) | ((instrLen >> 4) & 0xF);\n";
+		return true;
+	}
+
+	if (replaceTag == "OpLenSplit" && spec.remapTable.hasHuffmanOps())
+	{
+		// op/len word is the length only
+		outputFile << "		op = (SpvOp)smolv_ReadHuffmanOp(opBits, opBitPos);\n";
+		return true;
+	}
+
+	if (replaceTag == "DecodeLenCall" && spec.remapTable.hasFixedLengths())
+	{
+		outputFile << "		instrLen = bFixedLength ? kFixedLengths[opIndex - kVariableOps] : smolv_DecodeLen(op, instrLen);\n";
+		return true;
+	}
+
+	if (replaceTag == "OpRemapCall" && bDense)
+	{
+		outputFile << "		const uint32_t opIndex = op;\n";
+		outputFile << "		op = kSpirvDenseOps[opIndex];\n";
+		return true;
+	}
+
+	if (replaceTag == "OpDataLookup" && (bDense || spec.bPackedOpData))
+	{
+		// Dense table has every op code of the stream. Otherwise out of range ops read the Nop
+		// entry, which is all zeros, and the index select compiles to cmov.
+		const char* index = bDense ? "opIndex" : "op < sizeof(kSpirvOpData) ? op : 0";
+
+		if (spec.bPackedOpData)
+		{
+			outputFile << "		const uint32_t opBits = kSpirvOpData[" << index << "];\n";
+			outputFile << "		const OpData opInfo = { (uint8_t)(opBits & 1), (uint8_t)((opBits >> 1) & 1), (uint8_t)(opBits >> 4), (uint8_t)((opBits >> 2) & 1) };\n";
+		}
+		else
+		{
+			outputFile << "		const OpData opInfo = kSpirvOpData[" << index << "];\n";
+		}
+		return true;
+	}
+
+	if (replaceTag == "RelativeOperand" && (spec.bGroupVarint || spec.bIdContexts))
+	{
+		if (spec.bGroupVarint) outputFile << "			val = smolv_ReadGroupVarint(operandStream, operandGroups);\n";
+		else outputFile << "			val = smolv_ReadVarint(operandStream, packed_bytes_end);\n";
+
+		// ID contexts: absolute ID or zigzag delta from the result, selected by the low bit
+		if (spec.bIdContexts) outputFile << "			smolv_Write4(spirvCode, (val & 1) ? val >> 1 : prevResult - smolv_ZigDecode(val >> 1));\n";
+		else outputFile << "			smolv_Write4(spirvCode, prevResult - smolv_ZigDecode(val));\n";
+		return true;
+	}
+
+	if (replaceTag == "DecodeLoop" && spec.bMacros)
+	{
+		// A run ends at its own end, then the payload goes on after the reference
+		outputFile << "	while (packed_bytes < packed_bytes_end || smolv_MacroReturn(packed_bytes, packed_bytes_end, macroCaller, macroCallerEnd))\n";
+		return true;
+	}
+
+	if (replaceTag == "StreamCursors" && spec.bColumnar)
+	{
+		// Stream sizes first, op/len stream last, so that packed_bytes_end bounds all streams
+		outputFile << "	uint32_t streamSizes[5];\n";
+		outputFile << "	for (int s = 0; s < 5; ++s) streamSizes[s] = smolv_ReadVarint(packed_bytes, packed_bytes_end);\n";
+		outputFile << "	const uint8_t* typeStream = packed_bytes;\n";
+		outputFile << "	const uint8_t* resultStream = typeStream + streamSizes[0];\n";
+		outputFile << "	const uint8_t* operandStream = resultStream + streamSizes[1];\n";
+		outputFile << "	const uint8_t* literalStream = operandStream + streamSizes[2];\n";
+		outputFile << "	const uint8_t* memberStream = literalStream + streamSizes[3];\n";
+		outputFile << "	packed_bytes = memberStream + streamSizes[4];\n";
+		return true;
+	}
+
+	return false;
+}
+
+// --------------------------------------------------------------------------------------------
+
+void writeTemplateHeader(ostream& outputFile)
+{
+	for (const auto& segment : shadertemplateSegments)
+	{
+		if (segment.kind == TemplateSegmentKind::Shaderblock) break;
+		outputFile << segment.text;
+	}
+}
+
+// Walk precompiled template segments (generated_shadertemplate.h), copy/replace with conditions.
+// Markers are already parsed and checked for balance when building the tool.
+
+void writeDecoder(ostream& outputFile, const DecoderSpec& spec)
+{
+	const TemplateSegment* segment = begin(shadertemplateSegments);
+	const TemplateSegment* segmentEnd = end(shadertemplateSegments);
+
+	// Skip header part
+	while (segment < segmentEnd && segment->kind != TemplateSegmentKind::Shaderblock) segment++;
+
+	const AnalysisLookup& analysis = spec.lookup;
+	const bool bSkipOptimizer = spec.bSkipOptimizer;
+
+	bool bBlockModeOn = true;
+	bool bBlockInBlockModeOn = true;
+	bool bOptionModeOn = true;
+
+	// For replacing smol-v op remap with the one derived from our inputs
+	bool bRemapSegment = false;
+	bool bReplaceSegment = false;
+
+	for (; segment < segmentEnd; ++segment)
+	{
+		switch (segment->kind)
+		{
+		case TemplateSegmentKind::RemapStart:
+			// Write derived table instead of smol-v defaults, dense op codes don't use the remap at all
+			if (spec.remapTable.isDense())
+			{
+				bRemapSegment = true;
+			}
+			else if (spec.bUseRemapTable)
+			{
+				writeRemapTable(outputFile, spec.remapTable);
+				bRemapSegment = true;
+			}
+			break;
+
+		case TemplateSegmentKind::RemapEnd:
+			bRemapSegment = false;
+			break;
+
+		case TemplateSegmentKind::ReplaceStart:
+			bReplaceSegment = writeReplacement(outputFile, spec, segment->tag);
+			break;
+
+		case TemplateSegmentKind::ReplaceEnd:
+			bReplaceSegment = false;
+			break;
+
+		case TemplateSegmentKind::OptionStart:
+			bOptionModeOn = checkOption(spec, segment->tag);
+			break;
+
+		case TemplateSegmentKind::OptionEnd:
+			bOptionModeOn = true;
+			break;
+
+		case TemplateSegmentKind::BlockStart:
+			// Check if we have this segment in our database
+			bBlockModeOn = checkEntryFromBlocks(analysis, segment->tag) || bSkipOptimizer;
+			break;
+
+		case TemplateSegmentKind::BlockEnd:
+			bBlockModeOn = true;
+			break;
+
+		case TemplateSegmentKind::BlockInBlockStart:
+			bBlockInBlockModeOn = checkEntryFromBlocks(analysis, segment->tag) || bSkipOptimizer;
+			break;
+
+		case TemplateSegmentKind::BlockInBlockEnd:
+			bBlockInBlockModeOn = true;
+			break;
+
+		case TemplateSegmentKind::Spv:
+			// Check analysis, or copy also if we are skipping optimizer altogether
+			if (spec.remapTable.isDense())
+			{
+				// Whole dense table in place of the first row
+				if (segment->op == 0) writeDenseOpData(outputFile, spec);
+			}
+			else if (spec.bPackedOpData)
+			{
+				if (checkEntryFromSpv(analysis, segment->op) || bSkipOptimizer)
+				{
+					writeOpDataRow(outputFile, getSegmentOpData(*segment), true, getSegmentComment(*segment));
+				}
+				else
+				{
+					outputFile << "		0, // SPIRVCRUNCHER - op " << segment->op << " not in use\n";
+				}
+			}
+			else if (checkEntryFromSpv(analysis, segment->op) || bSkipOptimizer)
+			{
+				outputFile << segment->text;
+			}
+			else
+			{
+				// This is our best attempt to give crinkler size optimization opportunities for op-data
+				outputFile << "		{0, 0, 0, 0}, // SPIRVCRUNCHER - op " << segment->op << "not in use\n";
+			}
+			break;
+
+		case TemplateSegmentKind::Text:
+			if (!bRemapSegment && !bReplaceSegment && bOptionModeOn && bBlockModeOn && bBlockInBlockModeOn)
+			{
+				outputFile << segment->text;
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+// --------------------------------------------------------------------------------------------
+// Decoder signature
+
+// Unique Block and BlockInBlock tags of the template, in order of appearance
+static const vector<string>& getTemplateTags()
+{
+	static vector<string> tags;
+	if (tags.empty())
+	{
+		unordered_set<string> seen;
+		for (const auto& segment : shadertemplateSegments)
+		{
+			if (segment.kind != TemplateSegmentKind::BlockStart && segment.kind != TemplateSegmentKind::BlockInBlockStart) continue;
+			if (seen.insert(segment.tag).second) tags.push_back(segment.tag);
+		}
+	}
+	return tags;
+}
+
+static int getTemplateSpvCount()
+{
+	int count = 0;
+	for (const auto& segment : shadertemplateSegments)
+	{
+		if (segment.kind == TemplateSegmentKind::Spv) count++;
+	}
+	return count;
+}
+
+// Bits as hex, four bits per character starting from bit 0
+static string bitsToHex(const vector<bool>& bits)
+{
+	static const char kHex[] = "0123456789abcdef";
+	string result;
+	for (size_t i = 0; i < bits.size(); i += 4)
+	{
+		int nibble = 0;
+		for (size_t b = 0; b < 4 && i + b < bits.size(); ++b)
+		{
+			if (bits[i + b]) nibble |= 1 << b;
+		}
+		result += kHex[nibble];
+	}
+	return result;
+}
+
+static bool hexToBits(const string& hex, size_t bitCount, vector<bool>& bits)
+{
+	if (hex.size() != (bitCount + 3) / 4) return false;
+
+	bits.assign(bitCount, false);
+	for (size_t i = 0; i < hex.size(); ++i)
+	{
+		char c = hex[i];
+		int nibble = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+		if (nibble < 0) return false;
+
+		for (size_t b = 0; b < 4; ++b)
+		{
+			if (!(nibble & (1 << b))) continue;
+			if (i * 4 + b >= bitCount) return false;
+			bits[i * 4 + b] = true;
+		}
+	}
+	return true;
+}
+
+// Signature: <ops hex>.<blocks hex> or "all", optionally followed by .o<option letters> and
+// .r<op>-<code>-<share in 0.1%>_... or .d<op>_<op>_... for the dense op table, then
+// .l<variable nibbles>_<length>_... for the fixed length ops at the end of the dense table, or
+// .h<count>_<count>_... for the number of Huffman op codes of each length.
+// Option letters: p packed op data, i instrumented decrunch, c columnar payload, s shared prologue,
+// v variant payloads, t string table, f constant literals, x compact ops, g group varints, k ID contexts,
+// m macros
+string getDecoderSignature(const DecoderSpec& spec)
+{
+	string signature;
+
+	if (spec.bSkipOptimizer)
+	{
+		signature = "all";
+	}
+	else
+	{
+		vector<bool> opBits(getTemplateSpvCount());
+		for (size_t i = 0; i < opBits.size(); ++i) opBits[i] = spec.lookup.spvOps.test(i);
+
+		const vector<string>& tags = getTemplateTags();
+		vector<bool> blockBits(tags.size());
+		for (size_t i = 0; i < tags.size(); ++i) blockBits[i] = spec.lookup.blocks.count(tags[i]) != 0;
+
+		signature = bitsToHex(opBits) + "." + bitsToHex(blockBits);
+	}
+
+	if (spec.bPackedOpData || spec.bInstrument || spec.bColumnar || spec.bSharedPrologue || spec.bVariants || spec.bStringTable || spec.bConstantLiterals || spec.bCompactOps || spec.bGroupVarint || spec.bIdContexts || spec.bMacros)
+	{
+		signature += ".o";
+		if (spec.bPackedOpData) signature += "p";
+		if (spec.bInstrument) signature += "i";
+		if (spec.bColumnar) signature += "c";
+		if (spec.bSharedPrologue) signature += "s";
+		if (spec.bVariants) signature += "v";
+		if (spec.bStringTable) signature += "t";
+		if (spec.bConstantLiterals) signature += "f";
+		if (spec.bCompactOps) signature += "x";
+		if (spec.bGroupVarint) signature += "g";
+		if (spec.bIdContexts) signature += "k";
+		if (spec.bMacros) signature += "m";
+	}
+
+	if (spec.bUseRemapTable)
+	{
+		ostringstream remap;
+		remap << ".r";
+		for (size_t i = 0; i < spec.remapTable.swaps.size(); ++i)
+		{
+			const auto& swap = spec.remapTable.swaps[i];
+			if (i > 0) remap << "_";
+			remap << swap.op << "-" << swap.code << "-" << lround(swap.share * 10.0);
+		}
+		signature += remap.str();
+	}
+
+	if (spec.remapTable.isDense())
+	{
+		ostringstream dense;
+		dense << ".d";
+		for (size_t i = 0; i < spec.remapTable.denseOps.size(); ++i)
+		{
+			if (i > 0) dense << "_";
+			dense << spec.remapTable.denseOps[i];
+		}
+		signature += dense.str();
+	}
+
+	if (spec.remapTable.hasFixedLengths())
+	{
+		ostringstream fixed;
+		fixed << ".l" << spec.remapTable.variableNibbles;
+		for (uint8_t length : spec.remapTable.fixedLengths) fixed << "_" << (uint32_t)length;
+		signature += fixed.str();
+	}
+
+	if (spec.remapTable.hasHuffmanOps())
+	{
+		ostringstream huffman;
+		huffman << ".h";
+		for (size_t i = 0; i < spec.remapTable.huffmanLengthCounts.size(); ++i)
+		{
+			if (i > 0) huffman << "_";
+			huffman << spec.remapTable.huffmanLengthCounts[i];
+		}
+		signature += huffman.str();
+	}
+
+	return signature;
+}
+
+bool parseDecoderSignature(const string& signature, DecoderSpec& spec)
+{
+	spec = DecoderSpec();
+
+	vector<string> parts;
+	size_t start = 0;
+	while (start <= signature.size())
+	{
+		size_t end = signature.find('.', start);
+		if (end == string::npos) end = signature.size();
+		parts.push_back(signature.substr(start, end - start));
+		start = end + 1;
+	}
+
+	size_t part = 0;
+	if (parts[part] == "all")
+	{
+		spec.bSkipOptimizer = true;
+		part++;
+	}
+	else
+	{
+		if (parts.size() < 2) return false;
+
+		vector<bool> opBits, blockBits;
+		const vector<string>& tags = getTemplateTags();
+		if (!hexToBits(parts[0], getTemplateSpvCount(), opBits)) return false;
+		if (!hexToBits(parts[1], tags.size(), blockBits)) return false;
+
+		for (size_t i = 0; i < opBits.size(); ++i)
+		{
+			if (opBits[i]) spec.lookup.spvOps.set(i);
+		}
+		for (size_t i = 0; i < blockBits.size(); ++i)
+		{
+			if (blockBits[i]) spec.lookup.blocks.insert(tags[i]);
+		}
+		part += 2;
+	}
+
+	for (; part < parts.size(); ++part)
+	{
+		const string& p = parts[part];
+		if (!p.empty() && p[0] == 'o')
+		{
+			for (size_t i = 1; i < p.size(); ++i)
+			{
+				if (p[i] == 'p') spec.bPackedOpData = true;
+				else if (p[i] == 'i') spec.bInstrument = true;
+				else if (p[i] == 'c') spec.bColumnar = true;
+				else if (p[i] == 's') spec.bSharedPrologue = true;
+				else if (p[i] == 'v') spec.bVariants = true;
+				else if (p[i] == 't') spec.bStringTable = true;
+				else if (p[i] == 'f') spec.bConstantLiterals = true;
+				else if (p[i] == 'x') spec.bCompactOps = true;
+				else if (p[i] == 'g') spec.bGroupVarint = true;
+				else if (p[i] == 'k') spec.bIdContexts = true;
+				else if (p[i] == 'm') spec.bMacros = true;
+				else return false;
+			}
+			continue;
+		}
+		if (!p.empty() && p[0] == 'd')
+		{
+			vector<uint16_t> denseOps;
+			istringstream dense(p.substr(1));
+			string op;
+			while (getline(dense, op, '_'))
+			{
+				char* end = nullptr;
+				unsigned long opValue = strtoul(op.c_str(), &end, 10);
+				if (op.empty() || *end != 0 || opValue > 0xFFFF) return false;
+				denseOps.push_back((uint16_t)opValue);
+			}
+			if (denseOps.empty()) return false;
+			spec.remapTable.setDenseOps(denseOps);
+			continue;
+		}
+		if (!p.empty() && p[0] == 'l')
+		{
+			auto& table = spec.remapTable;
+			istringstream fixed(p.substr(1));
+			string value;
+			for (bool bFirst = true; getline(fixed, value, '_'); bFirst = false)
+			{
+				char* end = nullptr;
+				unsigned long number = strtoul(value.c_str(), &end, 10);
+				if (value.empty() || *end != 0) return false;
+				if (bFirst)
+				{
+					if (number > 15) return false;
+					table.variableNibbles = (uint32_t)number;
+				}
+				else
+				{
+					if (number < 1 || number > 255) return false;
+					table.fixedLengths.push_back((uint8_t)number);
+				}
+			}
+			if (!table.hasFixedLengths() || table.fixedLengths.size() > table.denseOps.size()) return false;
+			if (table.variableNibbles == 0 && table.variableOpCount() != 0) return false;
+			continue;
+		}
+		if (!p.empty() && p[0] == 'h')
+		{
+			auto& lengthCounts = spec.remapTable.huffmanLengthCounts;
+			istringstream huffman(p.substr(1));
+			string count;
+			size_t codeCount = 0;
+			while (getline(huffman, count, '_'))
+			{
+				char* end = nullptr;
+				unsigned long countValue = strtoul(count.c_str(), &end, 10);
+				if (count.empty() || *end != 0 || countValue > 0xFFFF) return false;
+				lengthCounts.push_back((uint16_t)countValue);
+				codeCount += countValue;
+			}
+			if (lengthCounts.empty() || lengthCounts.size() > kMaxHuffmanBits || codeCount != spec.remapTable.denseOps.size()) return false;
+			continue;
+		}
+		if (p.empty() || p[0] != 'r') return false;
+
+		spec.bUseRemapTable = true;
+		istringstream remap(p.substr(1));
+		string swap;
+		while (getline(remap, swap, '_'))
+		{
+			unsigned op = 0, code = 0, share = 0;
+			char dash1 = 0, dash2 = 0;
+			istringstream entry(swap);
+			if (!(entry >> op >> dash1 >> code >> dash2 >> share) || dash1 != '-' || dash2 != '-' || op > 0xFFFF || code > 0xF) return false;
+			spec.remapTable.swaps.push_back({ (uint16_t)op, (uint16_t)code, share / 10.0 });
+		}
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------------------------------------------
+// Decoder cache
+
+// FNV-1a
+static uint64_t hashBytes(uint64_t hash, const char* data, size_t size)
+{
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= (uint8_t)data[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+// Template fingerprint, so that a rebuilt tool with a changed template doesn't use old entries
+static uint64_t getTemplateHash()
+{
+	static uint64_t templateHash = 0;
+	if (templateHash == 0)
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (const auto& segment : shadertemplateSegments)
+		{
+			char kind = (char)segment.kind;
+			hash = hashBytes(hash, &kind, 1);
+			hash = hashBytes(hash, segment.tag, char_traits<char>::length(segment.tag));
+			hash = hashBytes(hash, segment.text.data(), segment.text.size());
+		}
+		templateHash = hash;
+	}
+	return templateHash;
+}
+
+string getDecoderText(const DecoderSpec& spec, const string& cacheDir, bool* bCacheHit)
+{
+	if (bCacheHit) *bCacheHit = false;
+
+	if (cacheDir.empty())
+	{
+		ostringstream decoder;
+		writeDecoder(decoder, spec);
+		return decoder.str();
+	}
+
+	string signature = getDecoderSignature(spec);
+	uint64_t key = hashBytes(getTemplateHash(), signature.data(), signature.size());
+
+	ostringstream fileName;
+	fileName << "decrunch_" << std::hex << std::setw(16) << std::setfill('0') << key << ".h";
+	fs::path cachePath = fs::path(cacheDir) / fileName.str();
+
+	// Cache hit, skip template processing
+	{
+		ifstream cached(cachePath, ios::binary);
+		if (cached)
+		{
+			string text((istreambuf_iterator<char>(cached)), istreambuf_iterator<char>());
+			if (!text.empty())
+			{
+				if (bCacheHit) *bCacheHit = true;
+				return text;
+			}
+		}
+	}
+
+	ostringstream decoder;
+	writeDecoder(decoder, spec);
+	string text = decoder.str();
+
+	// Write through temporary file, parallel batch runs may race for the same entry
+	error_code ec;
+	fs::create_directories(cacheDir, ec);
+
+	fs::path tempPath = cachePath;
+	tempPath += "." + to_string(chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+	{
+		ofstream cacheFile(tempPath, ios::binary);
+		if (cacheFile) cacheFile << text;
+	}
+	fs::rename(tempPath, cachePath, ec);
+	if (ec) fs::remove(tempPath, ec);
+
+	return text;
+}
@@ -0,0 +1,57 @@
+﻿// crunchtemplate.h - specialized decrunch generation from the precompiled template
+//
+// (c) 2025 Ossi Luoto
+
+#pragma once
+
+#include "smolv.h"
+#include "crunchencoder.h"
+
+#include <bitset>
+#include <string>
+#include <unordered_set>
+#include <ostream>
+
+// Analysis converted for template lookups: ops as bitset indexed by op, blocks as exact tags
+struct AnalysisLookup {
+	std::bitset<0x10000> spvOps;
+	std::unordered_set<std::string> blocks;
+};
+
+AnalysisLookup buildAnalysisLookup(const smolv::DecodeAnalysis& analysis);
+
+// Add block and op counts of one shader to the analysis of the whole input set
+void mergeAnalysis(smolv::DecodeAnalysis& globalAnalysis, const smolv::DecodeAnalysis& localAnalysis);
+
+// Everything the stripped decrunch text depends on
+struct DecoderSpec {
+	AnalysisLookup lookup;
+	bool bSkipOptimizer = false;
+	bool bUseRemapTable = false;
+	OpRemapTable remapTable;		// dense op table replaces the op remap, when set
+	bool bPackedOpData = false;		// kSpirvOpData as one byte per op
+	bool bInstrument = false;		// decrunch collects per op stats
+	bool bColumnar = false;			// payload fields in separate streams, read with one cursor each
+	bool bSharedPrologue = false;	// payloads splice declarations from shared_prologue
+	bool bVariants = false;			// variant payloads copy instructions from the decoded base
+	bool bStringTable = false;		// literal strings are indices to shared_strings
+	bool bConstantLiterals = false;	// OpConstant literals in the form given by the type
+	bool bCompactOps = false;		// compact CompositeExtract, CompositeConstruct and AccessChain pseudo ops
+	bool bGroupVarint = false;		// relative IDs and varint literals as group varints
+	bool bIdContexts = false;		// relative IDs as delta from the result or absolute
+	bool bMacros = false;			// instruction runs referenced from shared_macros
+};
+
+// Template part before the shader data (includes)
+void writeTemplateHeader(std::ostream& outputFile);
+
+// Template part after the shader data, stripped with the decoder spec
+void writeDecoder(std::ostream& outputFile, const DecoderSpec& spec);
+
+// Signature is a printable form of the decoder spec, "all" stands for the unstripped template.
+// Same signature always gives the same decoder with the same tool build.
+std::string getDecoderSignature(const DecoderSpec& spec);
+bool parseDecoderSignature(const std::string& signature, DecoderSpec& spec);
+
+// Decoder text memoized on disk by the hash of the signature, empty cacheDir disables the cache
+std::string getDecoderText(const DecoderSpec& spec, const std::string& cacheDir, bool* bCacheHit = nullptr);
@@ -0,0 +1,475 @@
+﻿// crunchvariant.cpp - shader variants encoded as edits of a base shader, and similarity order
+//
+// (c) 2025 Ossi Luoto
+
+#include "crunchvariant.h"
+#include "crunchmodule.h"
+#include "crunchencoder.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <unordered_map>
+
+using namespace std;
+using namespace smolv;
+
+// Candidate bases are found by MinHash signatures of the instruction shape sets, in LSH buckets of
+// signature bands, and the most similar few are compared with the full instruction diff
+static const size_t kCandidateLimit = 4;
+static const int kMinSimilarity = kMinHashes / 4;	// below this the base can't cover half of the shader
+static const int kMaxEdits = 1024;
+
+struct VariantModule {
+	bool bValid = false;
+	SpirvModule module;
+	vector<uint64_t> shapes;	// by instruction: op, length and the words other than IDs
+	MinHashSignature signature;
+};
+
+struct VariantEncoding {
+	vector<uint32_t> spirvWords;	// renumbered variant
+	vector<uint32_t> payloadWords;	// with copy runs
+	uint32_t bound = 0;
+	size_t copiedWords = 0;
+};
+
+static bool prepareModule(const ByteArray& spirv, bool bStripDebugInfo, VariantModule& variant)
+{
+	if (!parseSpirvModule(spirv, variant.module)) return false;
+	if (bStripDebugInfo && !stripSpirvDebugInfo(variant.module)) return false;
+
+	const SpirvModule& module = variant.module;
+	vector<bool> defined(module.header[3], false);
+	for (const auto& instruction : module.instructions)
+	{
+		if (instruction.result >= 0) defined[module.instructionWords(instruction)[instruction.result]] = true;
+	}
+
+	variant.signature.fill(0xFFFFFFFF);
+	for (const auto& instruction : module.instructions)
+	{
+		// Renumbering needs every referenced ID defined in the module
+		const uint32_t* words = module.instructionWords(instruction);
+		if (instruction.resultType >= 0 && !defined[words[instruction.resultType]]) return false;
+		for (uint16_t w : instruction.idOperands)
+		{
+			if (!defined[words[w]]) return false;
+		}
+
+		uint64_t shape = mixKey(instruction.op, instruction.length);
+		for (uint16_t w = 1; w < instruction.length; ++w) shape = mixKey(shape, instruction.isId(w) ? 0 : words[w]);
+		variant.shapes.push_back(shape);
+
+		for (int k = 0; k < kMinHashes; ++k)
+		{
+			variant.signature[k] = min(variant.signature[k], (uint32_t)(mixKey(shape, k) >> 32));
+		}
+	}
+
+	variant.bValid = true;
+	return true;
+}
+
+// Matching instruction pairs (base, variant) in order, from Myers' O((N+M)D) diff of the shapes.
+// Fails past maxEdits inserted and deleted instructions.
+static bool diffShapes(const vector<uint64_t>& a, const vector<uint64_t>& b, int maxEdits, vector<pair<uint32_t, uint32_t>>& matches)
+{
+	matches.clear();
+
+	size_t prefix = 0;
+	while (prefix < a.size() && prefix < b.size() && a[prefix] == b[prefix]) prefix++;
+	size_t suffix = 0;
+	while (suffix < a.size() - prefix && suffix < b.size() - prefix && a[a.size() - 1 - suffix] == b[b.size() - 1 - suffix]) suffix++;
+
+	const int n = (int)(a.size() - prefix - suffix);
+	const int m = (int)(b.size() - prefix - suffix);
+	const int limit = min(n + m, maxEdits);
+
+	// Furthest x on each diagonal k = x - y, kept for every edit count to walk the path back
+	vector<vector<int>> trace;
+	const int offset = limit + 1;
+	vector<int> v(2 * limit + 3, 0);
+	int edits = -1;
+	for (int d = 0; d <= limit && edits < 0; ++d)
+	{
+		trace.push_back(v);
+		for (int k = -d; k <= d; k += 2)
+		{
+			int x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) ? v[offset + k + 1] : v[offset + k - 1] + 1;
+			int y = x - k;
+			while (x < n && y < m && a[prefix + x] == b[prefix + y]) x++, y++;
+			v[offset + k] = x;
+			if (x >= n && y >= m)
+			{
+				edits = d;
+				break;
+			}
+		}
+	}
+	if (edits < 0) return false;
+
+	vector<pair<uint32_t, uint32_t>> middle;
+	int x = n, y = m;
+	for (int d = edits; d > 0; --d)
+	{
+		const vector<int>& previous = trace[d];
+		int k = x - y;
+		int previousK = (k == -d || (k != d && previous[offset + k - 1] < previous[offset + k + 1])) ? k + 1 : k - 1;
+		int previousX = previous[offset + previousK];
+		int previousY = previousX - previousK;
+		while (x > previousX && y > previousY)
+		{
+			x--, y--;
+			middle.push_back({ (uint32_t)(prefix + x), (uint32_t)(prefix + y) });
+		}
+		x = previousX;
+		y = previousY;
+	}
+	while (x > 0 && y > 0)
+	{
+		x--, y--;
+		middle.push_back({ (uint32_t)(prefix + x), (uint32_t)(prefix + y) });
+	}
+
+	for (size_t i = 0; i < prefix; ++i) matches.push_back({ (uint32_t)i, (uint32_t)i });
+	matches.insert(matches.end(), middle.rbegin(), middle.rend());
+	for (size_t i = 0; i < suffix; ++i) matches.push_back({ (uint32_t)(a.size() - suffix + i), (uint32_t)(b.size() - suffix + i) });
+	return true;
+}
+
+// Variant IDs of the matched instructions take the base IDs, the rest get new IDs from the base
+// bound in definition order. Instructions equal to their match after that are copied from the base.
+static bool encodeVariant(const VariantModule& base, const VariantModule& variant, VariantEncoding& encoding)
+{
+	vector<pair<uint32_t, uint32_t>> matches;
+	if (!diffShapes(base.shapes, variant.shapes, kMaxEdits, matches)) return false;
+
+	const SpirvModule& baseModule = base.module;
+	const SpirvModule& module = variant.module;
+	vector<int32_t> baseMatch(module.instructions.size(), -1);
+	vector<uint32_t> idMap(module.header[3], 0);
+	for (const auto& match : matches)
+	{
+		baseMatch[match.second] = (int32_t)match.first;
+		const auto& baseInstruction = baseModule.instructions[match.first];
+		const auto& instruction = module.instructions[match.second];
+		if (instruction.result >= 0)
+		{
+			idMap[module.instructionWords(instruction)[instruction.result]] = baseModule.instructionWords(baseInstruction)[baseInstruction.result];
+		}
+	}
+
+	uint32_t nextId = baseModule.header[3];
+	for (const auto& instruction : module.instructions)
+	{
+		if (instruction.result < 0) continue;
+		uint32_t& id = idMap[module.instructionWords(instruction)[instruction.result]];
+		if (!id) id = nextId++;
+	}
+
+	encoding = VariantEncoding();
+	encoding.bound = nextId;
+
+	vector<uint32_t>& payload = encoding.payloadWords;
+	size_t cursor = 0;				// base instructions the decrunch cursor has passed
+	size_t copyOp = SIZE_MAX;		// copy op at the end of the payload
+	for (size_t i = 0; i < module.instructions.size(); ++i)
+	{
+		const auto& instruction = module.instructions[i];
+		const uint32_t* words = module.instructionWords(instruction);
+
+		size_t start = encoding.spirvWords.size();
+		encoding.spirvWords.insert(encoding.spirvWords.end(), words, words + instruction.length);
+		for (uint16_t w = 1; w < instruction.length; ++w)
+		{
+			if (instruction.isId(w)) encoding.spirvWords[start + w] = idMap[words[w]];
+		}
+		const uint32_t* renumbered = encoding.spirvWords.data() + start;
+
+		int32_t match = baseMatch[i];
+		if (match < 0 || memcmp(renumbered, baseModule.instructionWords(baseModule.instructions[match]), instruction.length * 4) != 0)
+		{
+			payload.insert(payload.end(), renumbered, renumbered + instruction.length);
+			copyOp = SIZE_MAX;
+			continue;
+		}
+
+		// Extend the last run, add a run to the last copy op or start a new copy op
+		if (copyOp != SIZE_MAX && (size_t)match == cursor)
+		{
+			payload.back()++;
+		}
+		else if (copyOp != SIZE_MAX && (payload[copyOp] >> 16) + 2 <= 0xFFFF)
+		{
+			payload.push_back((uint32_t)(match - cursor));
+			payload.push_back(1);
+			payload[copyOp] += 2 << 16;
+		}
+		else
+		{
+			copyOp = payload.size();
+			payload.push_back((3 << 16) | kOpVariantCopy);
+			payload.push_back((uint32_t)(match - cursor));
+			payload.push_back(1);
+		}
+		cursor = match + 1;
+		encoding.copiedWords += instruction.length;
+	}
+	return true;
+}
+
+static bool readManifest(const string& manifestFile, const vector<EncodedShader>& shaders, vector<size_t>& bases, string& error)
+{
+	ifstream input(manifestFile);
+	if (!input)
+	{
+		error = "Cannot read variant manifest: " + manifestFile;
+		return false;
+	}
+
+	unordered_map<string, size_t> byName;
+	for (size_t s = 0; s < shaders.size(); ++s) byName[shaders[s].name] = s;
+
+	string line;
+	while (getline(input, line))
+	{
+		line = line.substr(0, line.find('#'));
+		istringstream names(line);
+		string name;
+		size_t base = SIZE_MAX;
+		while (names >> name)
+		{
+			auto found = byName.find(name);
+			if (found == byName.end())
+			{
+				error = "Unknown shader in variant manifest: " + name;
+				return false;
+			}
+
+			size_t s = found->second;
+			if (base == SIZE_MAX)
+			{
+				base = s;
+				if (bases[base] != SIZE_MAX)
+				{
+					error = "Variant used as a base in variant manifest: " + name;
+					return false;
+				}
+			}
+			else
+			{
+				if (bases[s] != SIZE_MAX || s == base)
+				{
+					error = "Shader listed twice in variant manifest: " + name;
+					return false;
+				}
+				bases[s] = base;
+			}
+		}
+	}
+
+	for (size_t s = 0; s < shaders.size(); ++s)
+	{
+		if (bases[s] != SIZE_MAX && bases[bases[s]] != SIZE_MAX)
+		{
+			error = "Variant used as a base in variant manifest: " + shaders[bases[s]].name;
+			return false;
+		}
+	}
+	return true;
+}
+
+int groupShaderVariants(vector<EncodedShader>& shaders, const string& manifestFile, bool bStripDebugInfo, string& error)
+{
+	vector<VariantModule> modules(shaders.size());
+	for (size_t s = 0; s < shaders.size(); ++s) prepareModule(shaders[s].spirv, bStripDebugInfo, modules[s]);
+
+	vector<size_t> bases(shaders.size(), SIZE_MAX);
+	vector<VariantEncoding> encodings(shaders.size());
+	int variantCount = 0;
+
+	if (!manifestFile.empty())
+	{
+		if (!readManifest(manifestFile, shaders, bases, error)) return -1;
+
+		// Listed variants that don't parse or are too far from their base are encoded on their own
+		for (size_t s = 0; s < shaders.size(); ++s)
+		{
+			size_t base = bases[s];
+			if (base == SIZE_MAX) continue;
+			if (!modules[s].bValid || !modules[base].bValid || !encodeVariant(modules[base], modules[s], encodings[s])) bases[s] = SIZE_MAX;
+		}
+	}
+	else
+	{
+		unordered_map<uint64_t, vector<size_t>> buckets;
+		for (size_t s = 0; s < shaders.size(); ++s)
+		{
+			if (!modules[s].bValid) continue;
+
+			vector<size_t> candidates;
+			for (int band = 0; band < kMinHashes / kBandSize; ++band)
+			{
+				auto found = buckets.find(getBandKey(modules[s].signature, band));
+				if (found == buckets.end()) continue;
+				size_t first = found->second.size() > kBucketScanLimit ? found->second.size() - kBucketScanLimit : 0;
+				candidates.insert(candidates.end(), found->second.begin() + first, found->second.end());
+			}
+			sort(candidates.begin(), candidates.end());
+			candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+			stable_sort(candidates.begin(), candidates.end(), [&](size_t a, size_t b) {
+				return getSimilarity(modules[a].signature, modules[s].signature) > getSimilarity(modules[b].signature, modules[s].signature);
+			});
+			if (candidates.size() > kCandidateLimit) candidates.resize(kCandidateLimit);
+			while (!candidates.empty() && getSimilarity(modules[candidates.back()].signature, modules[s].signature) < kMinSimilarity) candidates.pop_back();
+
+			VariantEncoding encoding;
+			for (size_t candidate : candidates)
+			{
+				if (!encodeVariant(modules[candidate], modules[s], encoding)) continue;
+				if (encoding.copiedWords * 2 < modules[s].module.words.size()) continue;
+				if (bases[s] == SIZE_MAX || encoding.copiedWords > encodings[s].copiedWords)
+				{
+					bases[s] = candidate;
+					encodings[s] = std::move(encoding);
+				}
+			}
+
+			if (bases[s] == SIZE_MAX)
+			{
+				for (int band = 0; band < kMinHashes / kBandSize; ++band) buckets[getBandKey(modules[s].signature, band)].push_back(s);
+			}
+		}
+	}
+
+	for (size_t s = 0; s < shaders.size(); ++s)
+	{
+		if (bases[s] == SIZE_MAX) continue;
+
+		const uint32_t* header = modules[s].module.header;
+		shaders[s].spirv = writeSpirvModule(header, encodings[s].bound, encodings[s].spirvWords);
+		shaders[s].payloadSpirv = writeSpirvModule(header, encodings[s].bound, encodings[s].payloadWords);
+		shaders[s].baseName = shaders[bases[s]].name;
+		variantCount++;
+	}
+	return variantCount;
+}
+
+// Shaders are ordered by MinHash signatures of their opcode trigram sets. Exact nearest neighbour
+// search is quadratic, larger sets look for the neighbours in LSH buckets of signature bands.
+static const size_t kExactOrderLimit = 4096;
+
+static uint32_t mixHash(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x85EBCA6B;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35;
+	h ^= h >> 16;
+	return h;
+}
+
+static MinHashSignature getMinHashSignature(const ByteArray& spirv)
+{
+	MinHashSignature signature;
+	signature.fill(0xFFFFFFFF);
+
+	uint32_t previous[2] = { 0, 0 };
+	size_t wordCount = spirv.size() / 4;
+	for (size_t i = 5; i < wordCount;)
+	{
+		uint32_t word;
+		memcpy(&word, &spirv[i * 4], 4);
+		uint32_t op = word & 0xFFFF;
+		uint32_t len = word >> 16;
+		if (len == 0) break;
+
+		uint32_t trigram = mixHash(op ^ mixHash(previous[0] ^ mixHash(previous[1])));
+		for (int k = 0; k < kMinHashes; ++k)
+		{
+			signature[k] = min(signature[k], mixHash(trigram + k * 0x9E3779B9));
+		}
+
+		previous[1] = previous[0];
+		previous[0] = op;
+		i += len;
+	}
+	return signature;
+}
+
+void orderShadersBySimilarity(vector<EncodedShader>& shaders)
+{
+	const size_t count = shaders.size();
+	if (count < 3) return;
+
+	vector<MinHashSignature> signatures;
+	for (const auto& shader : shaders) signatures.push_back(getMinHashSignature(shader.spirv));
+
+	const bool bExact = count <= kExactOrderLimit;
+	unordered_map<uint64_t, vector<uint32_t>> buckets;
+	if (!bExact)
+	{
+		// Reverse order, so that the scan from the back of a bucket meets the earliest shaders first
+		for (size_t i = count; i-- > 0;)
+		{
+			for (int band = 0; band < kMinHashes / kBandSize; ++band) buckets[getBandKey(signatures[i], band)].push_back((uint32_t)i);
+		}
+	}
+
+	vector<bool> used(count, false);
+	vector<size_t> order = { 0 };
+	used[0] = true;
+	size_t firstUnused = 1;
+
+	while (order.size() < count)
+	{
+		const MinHashSignature& current = signatures[order.back()];
+		size_t best = count;
+		int bestSimilarity = -1;
+
+		auto consider = [&](size_t i) {
+			int similarity = getSimilarity(current, signatures[i]);
+			if (similarity > bestSimilarity || (similarity == bestSimilarity && i < best))
+			{
+				best = i;
+				bestSimilarity = similarity;
+			}
+		};
+
+		if (bExact)
+		{
+			for (size_t i = firstUnused; i < count; ++i)
+			{
+				if (!used[i]) consider(i);
+			}
+		}
+		else
+		{
+			for (int band = 0; band < kMinHashes / kBandSize; ++band)
+			{
+				auto& bucket = buckets[getBandKey(current, band)];
+				while (!bucket.empty() && used[bucket.back()]) bucket.pop_back();
+
+				size_t scanned = 0;
+				for (size_t j = bucket.size(); j-- > 0 && scanned < kBucketScanLimit; ++scanned)
+				{
+					if (!used[bucket[j]]) consider(bucket[j]);
+				}
+			}
+		}
+
+		// Nothing similar left in the buckets, continue in the input order
+		while (used[firstUnused]) firstUnused++;
+		if (best == count) best = firstUnused;
+
+		used[best] = true;
+		order.push_back(best);
+	}
+
+	vector<EncodedShader> ordered;
+	ordered.reserve(count);
+	for (size_t i : order) ordered.push_back(std::move(shaders[i]));
+	shaders = std::move(ordered);
+}
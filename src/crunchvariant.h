@@ -0,0 +1,24 @@
+﻿// crunchvariant.h - shader variants encoded as edits of a base shader, and similarity order
+//
+// (c) 2025 Ossi Luoto
+
+#pragma once
+
+#include "crunchheader.h"
+
+#include <string>
+#include <vector>
+
+// Groups the shaders into base shaders and their variants. Manifest lines are "base variant
+// variant ..." by array name, # starts a comment. Without a manifest a shader is a variant of the
+// earlier base it shares the most instructions with, if the base covers at least half of its words.
+// A variant is renumbered to the base IDs where the instructions match, its spirv becomes the
+// module decrunch writes and payloadSpirv has kOpVariantCopy runs in place of the instructions
+// copied from the decoded base. Debug info is stripped here if requested, as the decoded base has
+// none to copy. Returns the number of variants, -1 with the error set on failure.
+int groupShaderVariants(std::vector<EncodedShader>& shaders, const std::string& manifestFile, bool bStripDebugInfo, std::string& error);
+
+// Greedy nearest neighbour order by opcode trigram similarity, starting from the first shader, so that
+// the packer finds similar payloads next to each other. Callers use the shaders by name, so the order
+// of the payloads is free.
+void orderShadersBySimilarity(std::vector<EncodedShader>& shaders);
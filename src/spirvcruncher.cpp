@@ -3,38 +3,40 @@
 // (c) 2025 Ossi Luoto
 
 #include "smolv.h"
+#include "crunchencoder.h"
+#include "crunchtemplate.h"
+#include "crunchreport.h"
+#include "crunchheader.h"
+#include "crunchestimate.h"
+#include "crunchmodule.h"
+#include "crunchoptimize.h"
+#include "crunchprologue.h"
+#include "crunchvariant.h"
+#include "crunchmacro.h"
 
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <chrono>
 #include <ctime>
 #include <iomanip>
 #include <filesystem>
 
-#include "generated_shadertemplate.h"
-
 using namespace std;
 using namespace smolv;
 namespace fs = std::filesystem;
 
-size_t headerToSkip = 24;
-
 struct ShaderInput {
 	string filename;
 	string arrayName;
 };
 
-struct EncodedShader {
-	string name;
-	ByteArray spirv;
-	ByteArray smolv;
-	size_t decodedSize;
-};
-
 static bool loadBinaryFile(const string& inFilePath, vector<uint8_t>& output)
 {
 	ifstream input(inFilePath, ios::binary);
@@ -101,388 +103,58 @@ static bool saveBinaryToArray(
 
 string getExecutableFolder() {
 
+#ifdef _WIN32
 	char buffer[MAX_PATH];
 	GetModuleFileName(NULL, buffer, MAX_PATH);
 
 	string fullPath(buffer);
+#else
+	error_code ec;
+	string fullPath = fs::read_symlink("/proc/self/exe", ec).string();
+#endif
 	size_t pos = fullPath.find_last_of("\\/");
 
 	return fullPath.substr(0, pos);
 }
 
-static bool checkEntryFromBlocks(DecodeAnalysis& analysis, string entryCheck)
-{
-	bool bResult = false;
-	for (auto block : analysis.Blocks)
-	{
-		// Check for block entry within the line
-		if (entryCheck.find(block.entry) != string::npos)
-		{
-			bResult = true;
-			break;
-		}
-	}
-	return bResult;
-}
-
-static bool checkEntryFromSpv(DecodeAnalysis& analysis, string entryCheck)
-{
-	bool bResult = false;
-	for (auto op : analysis.SpvOps)
-	{
-		// Check for block entry within the line
-		if (entryCheck.find(op.entry) != string::npos)
-		{
-			bResult = true;
-			break;
-		}
-	}
-	return bResult;
-}
-
-static bool copyTemplateWithConditions(istringstream& templateFile, ofstream& outputFile, DecodeAnalysis& analysis, bool bSkipOptimizer)
-{
-	string line;
-	int lineNumber = 0;
-	int spvLineNumber = 0;
-	bool bBlockSegment = false;
-	bool bSpvSegment = false;
-	bool bBlockModeOn = false;
-
-	// For at least special case for offset decorations
-	bool bBlockInBlock = false;
-	bool bBlockInBlockModeOn = false;
-
-	// For removing segments altogether
-	bool bRemoveSegment = false;
-
-	// Main loop, look for lines starting with our trigger code, copy/replace with conditions
-
-	while (getline(templateFile, line)) {
-		lineNumber++;
-
-		// Start of block optimization
-		if (!bSpvSegment && line.find("SPIRVCRUNCHER Block Start") != string::npos)
-		{
-			bBlockSegment = true;
-
-			// Check if we have this segment in our database
-			bBlockModeOn = checkEntryFromBlocks(analysis, line) || bSkipOptimizer;
-			continue;  // Skip the declaration lines
-		}
-
-		// Start of Spv chunk
-		if (!bBlockSegment && line.find("SPIRVCRUNCHER Spv Start") != string::npos)
-		{
-			bSpvSegment = true;
-			continue;  // Skip the declaration line
-		}
-
-		// End of Spv chunk
-		if (bSpvSegment && line.find("SPIRVCRUNCHER Spv End") != string::npos)
-		{
-			bSpvSegment = false;
-			continue;  // Skip the declaration line
-		}
-
-		// End of Block chunk
-		if (bBlockSegment && line.find("SPIRVCRUNCHER Block End") != string::npos)
-		{
-			bBlockSegment = false;
-			bBlockModeOn = false;
-			continue;
-		}
-
-		// 
-		// Remove completely on build
-		// 
-		
-		// Start of Remove segment
-		if (!bRemoveSegment && line.find("SPIRVCRUNCHER Remove on build start") != string::npos)
-		{
-			bRemoveSegment = true;
-			continue;  // Skip the declaration line
-		}
-
-		// End of Remove segment
-		if (bRemoveSegment && line.find("SPIRVCRUNCHER Remove on build end") != string::npos)
-		{
-			bRemoveSegment = false;
-			continue;  // Skip the declaration line
-		}
-
-		// Skip if remove segment mode one
-		if (bRemoveSegment) continue;
-
-		// Skip if deleteline
-		if (line.find("SPIRVCRUNCHER skip on build") != string::npos) continue;
-
-		// In blockmode, we copy only lines that are included in our database
-		if (bBlockSegment && bBlockModeOn)
-		{
-			// Likely in copy mode, but check first special conditions
-			if (!bBlockInBlock && line.find("SPIRVCRUNCHER BlockInBlock Start") != string::npos)
-			{
-				bBlockInBlock = true;
-				bBlockInBlockModeOn = checkEntryFromBlocks(analysis, line) || bSkipOptimizer;
-				continue;
-			}
-
-			if (bBlockInBlock && line.find("SPIRVCRUNCHER BlockInBlock End") != string::npos)
-			{
-				bBlockInBlock = false;
-				bBlockInBlockModeOn = false;
-				continue;
-			}
-
-			// Skip write if we are in block in block, but don't have blockinblock write-mode on
-			if (bBlockInBlock && !bBlockInBlockModeOn) continue;
-
-			// Else write
-			outputFile << line << '\n';
-			continue;
-		}
-
-		// In Spvmode, check if have the op in question in our database, else fill with empty
-		if (bSpvSegment)
-		{
-			// Check analysis, or copy also if we are skipping optimizer altogether
-			if (checkEntryFromSpv(analysis, to_string(spvLineNumber)) || bSkipOptimizer)
-			{
-				outputFile << line << '\n';
-			}
-			else
-			{
-				// This is our best attempt to give crinkler size optimization opportunities for op-data
-				outputFile << "		{0, 0, 0, 0}, // SPIRVCRUNCHER - op " << spvLineNumber << "not in use\n";
-			}
-			spvLineNumber++;
-			continue;
-		}
-
-		// Else copy if we are not block or spv mode
-		if (!bSpvSegment && !bBlockSegment)
-		{
-			outputFile << line << '\n';
-			continue;
-		}
-	}
-
-	if (bSpvSegment || bBlockSegment) return false;
-
-	// Implement other fail checks?
-	return true;
-}
-
-static bool generateUberHeader(
-	istringstream& templateFile,
-	ofstream& outputFile,
-	DecodeAnalysis& analysis,
-	const vector<EncodedShader>& shaders,
-	bool bSkipOptimizer, bool bSkipCruncher)
-{
-	bool bResult = true;
-
-	//
-	// 1. Header 
-	//
-
-	{
-		outputFile << "//\n// Generated with spirvcruncher on: ";
-		// Timestamp
-		auto now = chrono::system_clock::now();
-		time_t now_time = chrono::system_clock::to_time_t(now);
-		tm* local_time = localtime(&now_time);
-		outputFile << std::put_time(local_time, "%Y-%m-%d %H:%M:%S");
-
-		outputFile << "\n//\n";
-
-		string line;
-		bool bSegmentDone = false;
-		while (!bSegmentDone) {
-			getline(templateFile, line);
-
-			if (line.find("SPIRVCRUNCHER Shaderblock") != string::npos)
-			{
-				bSegmentDone = true;
-				continue;
-			}
-			else
-			{
-				outputFile << line << '\n';
-			}
-		}
-	}
-
-	//
-	// 2. Shadercode
-	//
-	// First, check if all shaders share the same SPIR-V Version to optimize size
-
-	bool allVersionsMatch = true;
-	uint32_t sharedVersionWord = 0;
-
-	for (size_t i = 0; i < shaders.size(); ++i) {
-		// Reconstruct the 32-bit version word correctly from little-endian bytes
-		uint32_t versionWord = shaders[i].spirv[4] |
-			(shaders[i].spirv[5] << 8) |
-			(shaders[i].spirv[6] << 16) |
-			(shaders[i].spirv[7] << 24);
-
-		if (i == 0) sharedVersionWord = versionWord;
-		else if (versionWord != sharedVersionWord) allVersionsMatch = false;
-	}
-
-	if (allVersionsMatch && !shaders.empty()) {
-		outputFile << "constexpr uint32_t shared_spvVersion = 0x"
-			<< std::hex << std::setw(8) << std::setfill('0') << sharedVersionWord << std::dec << ";\n\n";
-	}
-
-	// PASS 1: Group all packed bytes together in one Data Segment
-
-	outputFile << "// --- Compressed Shader Payloads ---\n";
-	outputFile << "#pragma data_seg(\".smolv\")\n\n";
-
-	for (const auto& shader : shaders) {
-		// For debugging
-		size_t skipHeader = bSkipCruncher ? 0 : headerToSkip;
-		size_t dataSizeNoHeader = shader.smolv.size() - skipHeader;
-
-		outputFile << "const uint8_t " << shader.name << "[] = {\n\n";
-
-		size_t count = 0;
-		for (size_t i = 0; i < dataSizeNoHeader; ++i) {
-			if (count % 12 == 0) outputFile << "    ";
-
-			outputFile << "0x" << std::hex << std::setw(2) << std::setfill('0')
-				<< static_cast<int>(shader.smolv[i + skipHeader]);
-
-			if (i != dataSizeNoHeader - 1) outputFile << ", ";
-			++count;
-			if (count % 12 == 0) outputFile << "\n";
-		}
-
-		outputFile << "\n};\n\n";
-	}
-
-	// Reset data segment to default
-	outputFile << "#pragma data_seg()\n\n";
-
-	// PASS 2: Group all metadata together
-
-	outputFile << "// --- Metadata ---\n";
-	for (const auto& shader : shaders) {
-		size_t skipHeader = bSkipCruncher ? 0 : headerToSkip;
-		size_t dataSizeNoHeader = shader.smolv.size() - skipHeader;
-
-		outputFile << std::dec << std::setw(0) << std::setfill(' ');
-		outputFile << "constexpr size_t " << shader.name << "_encoded_sizeInBytes = " << dataSizeNoHeader << ";\n";
-		outputFile << "constexpr size_t " << shader.name << "_sizeInBytes = " << shader.decodedSize << ";\n";
-
-		if (!bSkipCruncher) {
-			if (!allVersionsMatch) {
-				uint32_t versionWord = shader.spirv[4] | (shader.spirv[5] << 8) | (shader.spirv[6] << 16) | (shader.spirv[7] << 24);
-				outputFile << "constexpr uint32_t " << shader.name << "_spvVersion = 0x"
-					<< std::hex << std::setw(8) << std::setfill('0') << versionWord << std::dec << ";\n";
-			}
-
-			uint32_t boundWord = shader.spirv[12] | (shader.spirv[13] << 8) | (shader.spirv[14] << 16) | (shader.spirv[15] << 24);
-			outputFile << "constexpr uint32_t " << shader.name << "_spvBound = 0x"
-				<< std::hex << std::setw(8) << std::setfill('0') << boundWord << std::dec << ";\n";
-		}
-		outputFile << "\n";
-	}
-
-
-
-	/*
-		outputFile << std::dec << std::setw(0) << std::setfill(' ');
-//		outputFile << "constexpr size_t " << shader.name << "_encoded_sizeInBytes = " << dataSizeNoHeader << ";\n";
-		outputFile << "constexpr size_t " << shader.name << "_sizeInBytes = " << shader.decodedSize << "; \n";
-
-		if (!bSkipCruncher)
-		{
-			if (!allVersionsMatch) {
-				uint32_t versionWord = shader.spirv[4] | (shader.spirv[5] << 8) | (shader.spirv[6] << 16) | (shader.spirv[7] << 24);
-				outputFile << "constexpr uint32_t " << shader.name << "_spvVersion = 0x"
-					<< std::hex << std::setw(8) << std::setfill('0') << versionWord << std::dec << ";\n";
-			}
-
-			// Reconstruct Bound correctly
-			uint32_t boundWord = shader.spirv[12] | (shader.spirv[13] << 8) | (shader.spirv[14] << 16) | (shader.spirv[15] << 24);
-			outputFile << "constexpr uint32_t " << shader.name << "_spvBound = 0x"
-				<< std::hex << std::setw(8) << std::setfill('0') << boundWord << std::dec << ";\n";
-		}
-		*/
-
-	// PASS 3: Group all uninitialized buffers in the BSS Segment
-
-	outputFile << "// --- Uninitialized Memory Buffers (BSS) ---\n";
-	outputFile << "#pragma bss_seg(\".spirvbss\")\n\n";
-
-	for (const auto& shader : shaders) {
-		size_t bufferWords = (shader.decodedSize + 3) / 4;
-
-		outputFile << "inline uint32_t " << shader.name << "_buffer[" << bufferWords << "];\n";
-	}
-
-	// Reset bss segment to default
-	outputFile << "\n#pragma bss_seg()\n\n";
-
-	/*
-		// Allocate zero-initialized 32-bit aligned space
-		size_t bufferWords = (shader.decodedSize + 3) / 4;
-		outputFile << "inline uint32_t " << shader.name << "_buffer[" << bufferWords << "] = {};\n\n";
-	}
-	*/
-
-	// Generate debug "decoder" and macro
-	if (bSkipCruncher)
-	{
-		outputFile << "// BYPASS MODE: smol-v decrunch skipped. Doing raw 32-bit copy.\n";
-		outputFile << "inline void decrunch_bypass(const uint8_t* src, size_t sizeInBytes, uint32_t* dst) {\n";
-		outputFile << "\tconst uint32_t* src32 = (const uint32_t*)src;\n";
-		outputFile << "\tfor (size_t i = 0; i < sizeInBytes / 4; ++i) {\n";
-		outputFile << "\t\tdst[i] = src32[i];\n";
-		outputFile << "\t}\n";
-		outputFile << "}\n\n";
-
-		outputFile << "#define DECRUNCH_ALL_SHADERS() \\\n";
-		for (size_t i = 0; i < shaders.size(); ++i) {
-			const auto& s = shaders[i];
-			outputFile << "\tdecrunch_bypass(" << s.name << ", " << s.name << "_sizeInBytes, " << s.name << "_buffer)";
-			if (i < shaders.size() - 1) outputFile << "; \\\n";
-			else outputFile << "\n\n";
-		}
-	}
-	else
-	{
-		outputFile << "// Macro to decrunch all shaders into their respective buffers\n";
-		outputFile << "#define DECRUNCH_ALL_SHADERS() \\\n";
-		for (size_t i = 0; i < shaders.size(); ++i) {
-			const auto& s = shaders[i];
-			string v = allVersionsMatch ? "shared_spvVersion" : s.name + "_spvVersion";
-			outputFile << "\tdecrunch(" << s.name << ", " << s.name << " + " << s.name << "_encoded_sizeInBytes, " << v << ", " << s.name << "_spvBound, (uint8_t*)" << s.name << "_buffer)";
-			if (i < shaders.size() - 1) outputFile << "; \\\n";
-			else outputFile << "\n\n";
-		}
-
-		bResult = copyTemplateWithConditions(templateFile, outputFile, analysis, bSkipOptimizer);
-		if (!bResult) return false;
-	}
-
-	return true;
-}
-
-
 int main(int argc, char* argv[])
 {
+	CrunchReport report;
+	auto phaseStart = CrunchClock::now();
+
 	vector<ShaderInput> inputs;
 	string filenameOut = "spirvcrunchedshaders.h";
 	bool bStripEncodeFlags = false;
 	bool bSilent = false;
 	bool bSkipOptimizer = false;   // For sanity checking that the code optimizer is working as intended
 	bool bSkipCruncher = false;    // For sanity checking that smol-v packer is working, this means in practice that decrunch is just a copy operation
+	bool bRemapOps = false;        // Use op remap table derived from the inputs instead of smol-v defaults
+	bool bPackedOpData = false;    // One byte per op in decoder kSpirvOpData instead of four
+	bool bDenseOps = false;        // Op codes index a dense table of the ops in use
+	bool bInstrument = false;      // decrunch collects per op counts, bytes, words and time
+	bool bNoDecoder = false;       // Leave decrunch out of the header, to be shared from --decoder-only output
+	bool bColumnar = false;        // Payload fields in separate streams
+	bool bEstimate = false;        // Estimate the packed size of payloads and decoder
+	bool bDeadCode = false;        // Unreachable functions and unreferenced declarations removed before encoding
+	bool bRenumber = false;        // IDs renumbered in definition order before encoding
+	bool bSharedPrologue = false;  // Declarations common to the shaders stored once, with canonical IDs
+	string variants = "";          // "auto" or a manifest file, variants are encoded against a base shader
+	bool bStringTable = false;     // Literal strings stored once, payloads refer to them by index
+	bool bConstants = false;       // OpConstant literals as zigzag or float transform varints
+	bool bCompactOps = false;      // Compact pseudo ops for CompositeExtract, CompositeConstruct and AccessChain
+	bool bGroupVarint = false;     // Relative IDs and varint literals as group varints, for decode speed
+	bool bIdContexts = false;      // Relative IDs as delta from the result or absolute, the smaller
+	bool bFixedLengths = false;    // Dense op table, ops of the same length in all inputs written without length
+	bool bHuffmanOps = false;      // Dense op table, op codes as canonical Huffman codes in a bit stream
+	bool bMacros = false;          // Instruction runs repeated across the payloads stored once, payloads refer to them
+	string spirvOutDir = "";       // Modules after the passes before encoding go here, if set
+	string order = "input";        // Payload order, "input" or "similarity"
+	bool bOutputSet = false;
+	string cacheDir = "";          // Specialized decoders are cached here, if set
+	string decoderOnlySignature = "";
+	bool bTimings = false;         // Print phase timings and per shader rows
+	string reportFormat = "";      // Machine readable report, "json"
+	string reportFile = "";        // Report goes to stdout if not set
 
 	string currentFile = "";
 	string currentName = "";
@@ -524,7 +196,10 @@ int main(int argc, char* argv[])
 			if (i + 1 < argc) currentName = argv[++i];
 		}
 		else if (arg == "-o" || arg == "--output") {
-			if (i + 1 < argc) filenameOut = argv[++i];
+			if (i + 1 < argc) {
+				filenameOut = argv[++i];
+				bOutputSet = true;
+			}
 		}
 		else if (arg == "-d" || arg == "--stripdebuginfo") {
 			bStripEncodeFlags = true;
@@ -539,6 +214,92 @@ int main(int argc, char* argv[])
 			bSkipCruncher = true;
 			bSkipOptimizer = true;
 		}
+		else if (arg == "-r" || arg == "--remap") {
+			bRemapOps = true;
+		}
+		else if (arg == "-p" || arg == "--packedops") {
+			bPackedOpData = true;
+		}
+		else if (arg == "--denseops") {
+			bDenseOps = true;
+		}
+		else if (arg == "--instrument") {
+			bInstrument = true;
+		}
+		else if (arg == "--timings") {
+			bTimings = true;
+		}
+		else if (arg == "--report") {
+			if (i + 1 < argc) reportFormat = argv[++i];
+			if (reportFormat != "json") {
+				cerr << "Unknown report format: " << reportFormat << endl;
+				return 1;
+			}
+		}
+		else if (arg == "--report-file") {
+			if (i + 1 < argc) reportFile = argv[++i];
+		}
+		else if (arg == "--cache") {
+			if (i + 1 < argc) cacheDir = argv[++i];
+		}
+		else if (arg == "--decoder-only") {
+			if (i + 1 < argc) decoderOnlySignature = argv[++i];
+		}
+		else if (arg == "--nodecoder") {
+			bNoDecoder = true;
+		}
+		else if (arg == "--columnar") {
+			bColumnar = true;
+		}
+		else if (arg == "--estimate") {
+			bEstimate = true;
+		}
+		else if (arg == "--dce") {
+			bDeadCode = true;
+		}
+		else if (arg == "--renumber") {
+			bRenumber = true;
+		}
+		else if (arg == "--prologue") {
+			bSharedPrologue = true;
+		}
+		else if (arg == "--variants") {
+			if (i + 1 < argc) variants = argv[++i];
+		}
+		else if (arg == "--strings") {
+			bStringTable = true;
+		}
+		else if (arg == "--constants") {
+			bConstants = true;
+		}
+		else if (arg == "--compact") {
+			bCompactOps = true;
+		}
+		else if (arg == "--groupvarint") {
+			bGroupVarint = true;
+		}
+		else if (arg == "--contexts") {
+			bIdContexts = true;
+		}
+		else if (arg == "--fixedlen") {
+			bFixedLengths = true;
+		}
+		else if (arg == "--huffman") {
+			bHuffmanOps = true;
+		}
+		else if (arg == "--macros") {
+			bMacros = true;
+		}
+		else if (arg == "--spirv-out") {
+			if (i + 1 < argc) spirvOutDir = argv[++i];
+		}
+		else if (arg == "--order") {
+			if (i + 1 < argc) order = argv[++i];
+			if (order != "input" && order != "similarity") {
+				cerr << "Unknown order: " << order << endl;
+				return 1;
+			}
+		}
 		else {
 			cerr << "Unknown option: " << arg << endl;
 			return 1;
@@ -550,9 +311,44 @@ int main(int argc, char* argv[])
 		inputs.push_back({ currentFile, currentName.empty() ? fs::path(currentFile).stem().string() : currentName });
 	}
 
+	// JSON report on stdout replaces the progress output
+	const bool bJsonToStdout = reportFormat == "json" && reportFile.empty();
+	if (bJsonToStdout) bSilent = true;
+
+	report.addPhase("discover", phaseStart);
+
+	// Only print the specialized decoder for a given signature
+	if (!decoderOnlySignature.empty())
+	{
+		DecoderSpec decoderSpec;
+		if (!parseDecoderSignature(decoderOnlySignature, decoderSpec)) {
+			cerr << "Invalid decoder signature: " << decoderOnlySignature << endl;
+			return 1;
+		}
+
+		ofstream outFile;
+		if (bOutputSet) {
+			outFile.open(filenameOut);
+			if (!outFile) {
+				cerr << "Cannot open output file" << std::endl;
+				return 1;
+			}
+		}
+		ostream& output = bOutputSet ? outFile : cout;
+
+		output << "//\n// Decoder generated with spirvcruncher, signature: " << decoderOnlySignature << "\n//\n";
+		writeTemplateHeader(output);
+		output << getDecoderText(decoderSpec, cacheDir);
+
+		return output.good() ? 0 : 1;
+	}
+
 	if (inputs.empty())
 	{
-		cerr << "Usage: " << argv[0] << " -i <shader1.spv> [-n <name1>] [-i <shader2.spv> [-n <name2>]] [-o <output_header>] [-d] [-s]\n";
+		cerr << "Usage: " << argv[0] << " -i <shader1.spv> [-n <name1>] [-i <shader2.spv> [-n <name2>]] [-o <output_header>] [-d] [-s] [-r] [-p] [--denseops] [--columnar] [--instrument] [--cache <dir>] [--nodecoder]\n";
+		cerr << "       " << "[--timings] [--report json] [--report-file <file>] [--estimate] [--order <input|similarity>]\n";
+		cerr << "       " << "[--dce] [--renumber] [--prologue] [--variants <auto|manifest>] [--strings] [--constants] [--compact] [--groupvarint] [--contexts] [--fixedlen] [--huffman] [--macros] [--spirv-out <dir>]\n";
+		cerr << "       " << argv[0] << " --decoder-only <signature> [-o <output_header>] [--cache <dir>]\n";
 		return 1;
 	}
 
@@ -563,76 +359,355 @@ int main(int argc, char* argv[])
 	for (const auto& input : inputs) {
 		if (!bSilent) cout << "Processing: " << input.filename << " as " << input.arrayName << endl;
 
-		ByteArray spirv, smolv;
+		ByteArray spirv;
+		phaseStart = CrunchClock::now();
 		if (!loadBinaryFile(input.filename, spirv) || spirv.empty()) {
 			cerr << "Failed to read: " << input.filename << endl;
 			return 1;
 		}
+		report.addPhase("load", phaseStart);
+
+		CrunchShaderRow row = { input.arrayName, spirv.size(), 0, 0, 0.0, 0.0 };
+		if (spirv.size() >= 16) row.bound = spirv[12] | (spirv[13] << 8) | (spirv[14] << 16) | (spirv[15] << 24);
+
+		EncodedShader shader;
+		shader.name = input.arrayName;
+		shader.spirv = std::move(spirv);
+		processedShaders.push_back(std::move(shader));
+		report.shaders.push_back(row);
+	}
+
+	// Passes over the whole input set before encoding. Dead code goes first, so that renumbering
+	// leaves no gaps. Renumbering gives dense IDs and a lower bound, smol-v result deltas then are
+	// mostly +1. Shared prologue canonicalizes the IDs itself.
+	if ((bDeadCode || bRenumber) && !bSkipCruncher)
+	{
+		phaseStart = CrunchClock::now();
+		size_t removedInstructions = 0;
+		size_t renumbered = 0;
+		for (auto& shader : processedShaders) {
+			SpirvModule module;
+			if (!parseSpirvModule(shader.spirv, module) || (bStripEncodeFlags && !stripSpirvDebugInfo(module))) {
+				if (!bSilent) cout << "Skipped " << shader.name << " in --dce and --renumber, the module has ops they can't rewrite" << endl;
+				continue;
+			}
+
+			size_t removed = 0;
+			if (bDeadCode && eliminateDeadCode(module, removed)) removedInstructions += removed;
+			if (bRenumber && renumberSpirvIds(module)) renumbered++;
+			shader.spirv = writeSpirvModule(module);
+		}
+		report.addPhase("optimize", phaseStart);
+
+		if (!bSilent && bDeadCode) cout << "Removed " << removedInstructions << " dead instructions" << endl;
+		if (!bSilent && bRenumber) cout << "Renumbered IDs of " << renumbered << " shaders" << endl;
+	}
+
+	SharedPrologue sharedPrologue;
+	bool bUseSharedPrologue = bSharedPrologue && !bSkipCruncher;
+	if (bUseSharedPrologue)
+	{
+		phaseStart = CrunchClock::now();
+		if (!extractSharedPrologue(processedShaders, sharedPrologue, bStripEncodeFlags)) {
+			cerr << "Failed to extract shared prologue" << endl;
+			return 1;
+		}
+		report.prologueBytes = sharedPrologue.words.size() * 4;
+		report.addPhase("prologue", phaseStart);
+
+		if (!bSilent) cout << "Shared prologue with " << sharedPrologue.instructionCount << " instructions, " << report.prologueBytes << " bytes" << endl;
+	}
+
+	// Variants after the prologue, they copy from the base as decrunch writes it
+	bool bUseVariants = !variants.empty() && !bSkipCruncher;
+	if (bUseVariants)
+	{
+		phaseStart = CrunchClock::now();
+		string error;
+		int variantCount = groupShaderVariants(processedShaders, variants == "auto" ? "" : variants, bStripEncodeFlags, error);
+		if (variantCount < 0) {
+			cerr << error << endl;
+			return 1;
+		}
+		report.addPhase("variants", phaseStart);
+
+		if (!bSilent) cout << "Encoded " << variantCount << " shaders as variants of a base shader" << endl;
+	}
+
+	// Compact pseudo ops go in the payload module before the analysis, so that the op tables count
+	// them. Payloads start from the module decrunch writes, stripped here if the encoder would strip.
+	bool bUseCompactOps = bCompactOps && !bSkipCruncher;
+	if (bUseCompactOps)
+	{
+		phaseStart = CrunchClock::now();
+		size_t compacted = 0;
+		for (auto& shader : processedShaders) {
+			if (shader.payloadSpirv.empty()) {
+				if (bStripEncodeFlags) {
+					SpirvModule module;
+					if (!parseSpirvModule(shader.spirv, module) || !stripSpirvDebugInfo(module)) continue;
+					shader.spirv = writeSpirvModule(module);
+				}
+				shader.payloadSpirv = shader.spirv;
+			}
+			compacted += rewriteCompactOps(shader.payloadSpirv);
+		}
+		report.addPhase("compact", phaseStart);
+
+		if (!bSilent) cout << "Rewrote " << compacted << " instructions to compact pseudo ops" << endl;
+	}
 
-		size_t decodedSize = 0;
+	for (size_t i = 0; i < processedShaders.size(); ++i) {
+		auto& shader = processedShaders[i];
+		auto& row = report.shaders[i];
+		const ByteArray& spirv = shader.payloadSpirv.empty() ? shader.spirv : shader.payloadSpirv;
 
 		if (bSkipCruncher)
 		{
 			// just copy
-			smolv = spirv;
-			decodedSize = spirv.size();
+			shader.smolv = spirv;
+			shader.decodedSize = spirv.size();
 		}
 		else
 		{
 			// Encode to smol-v
-			if (!Encode(spirv.data(), spirv.size(), smolv, bStripEncodeFlags ? kEncodeFlagStripDebugInfo : 0)) {
-				cerr << "Failed to encode smolv: " << input.filename << endl;
+			phaseStart = CrunchClock::now();
+			if (!Encode(spirv.data(), spirv.size(), shader.smolv, bStripEncodeFlags ? kEncodeFlagStripDebugInfo : 0)) {
+				cerr << "Failed to encode smolv: " << shader.name << endl;
 				return 1;
 			}
+			row.encodeUs = elapsedUs(phaseStart);
+			report.addPhase("encode", phaseStart);
 
-			decodedSize = GetDecodedBufferSize(smolv.data(), smolv.size());
-			if (decodedSize > 0) {
+			phaseStart = CrunchClock::now();
+			shader.decodedSize = GetDecodedBufferSize(shader.smolv.data(), shader.smolv.size());
+			if (shader.decodedSize > 0) {
 				ByteArray returnspirv;
-				returnspirv.resize(decodedSize);
+				returnspirv.resize(shader.decodedSize);
 				DecodeAnalysis localAnalysis;
 
-				if (DecodeWithAnalysis(smolv.data(), smolv.size(), returnspirv.data(), decodedSize, &localAnalysis, kDecodeFlagNone)) {
-					// Merge local blocks into global
-					for (const auto& block : localAnalysis.Blocks) {
-						bool found = false;
-						for (auto& gBlock : globalAnalysis.Blocks) {
-							if (gBlock.entry == block.entry) { gBlock.count += block.count; found = true; break; }
-						}
-						if (!found) globalAnalysis.Blocks.push_back(block);
-					}
+				if (DecodeWithAnalysis(shader.smolv.data(), shader.smolv.size(), returnspirv.data(), shader.decodedSize, &localAnalysis, kDecodeFlagNone)) {
+					mergeAnalysis(globalAnalysis, localAnalysis);
+				}
+			}
+			row.analyzeUs = elapsedUs(phaseStart);
+			report.addPhase("analyze", phaseStart);
 
-					// Merge local ops into global
-					for (const auto& op : localAnalysis.SpvOps) {
-						bool found = false;
-						for (auto& gOp : globalAnalysis.SpvOps) {
-							if (gOp.entry == op.entry) { gOp.count += op.count; found = true; break; }
-						}
-						if (!found) globalAnalysis.SpvOps.push_back(op);
-					}
+			// Splices make the payload module differ from what decrunch writes
+			if (!shader.payloadSpirv.empty()) shader.decodedSize = shader.spirv.size();
+		}
+	}
+
+	// Re-encode with op remap or dense op table trained from the whole input set. Dense table is
+	// in frequency order, which already gives the hot ops single nibble codes. Columnar payload
+	// alone keeps the smol-v op remap, as do the shared prologue, variants and the other crunchEncode
+	// payload options. Macro references need the interleaved payload, and the macro op has a place in
+	// the trained tables by its reference count from a first pass.
+	OpRemapTable remapTable;
+	StringTable stringTable;
+	bool bUseHuffmanOps = bHuffmanOps && !bSkipCruncher;
+	bool bUseFixedLengths = bFixedLengths && !bSkipCruncher && !bUseHuffmanOps;
+	bool bUseDenseOps = (bDenseOps || bUseFixedLengths || bUseHuffmanOps) && !bSkipCruncher;
+	bool bUseRemapTable = bRemapOps && !bSkipCruncher && !bUseDenseOps;
+	bool bUseColumnar = bColumnar && !bSkipCruncher;
+	bool bUseStringTable = bStringTable && !bSkipCruncher;
+	bool bUseConstants = bConstants && !bSkipCruncher;
+	bool bUseGroupVarint = bGroupVarint && !bSkipCruncher;
+	bool bUseIdContexts = bIdContexts && !bSkipCruncher;
+	bool bUseMacros = bMacros && !bSkipCruncher && !bUseColumnar && !bUseGroupVarint && !bUseHuffmanOps;
+	MacroDictionary macros;
+
+	if (!bSilent && bFixedLengths && !bSkipCruncher && !bUseFixedLengths) cout << "--fixedlen has no effect with --huffman" << endl;
+	if (!bSilent && bMacros && !bSkipCruncher && !bUseMacros) cout << "--macros has no effect with --columnar, --groupvarint or --huffman" << endl;
+
+	if (bUseRemapTable || bUseDenseOps || bUseColumnar || bUseSharedPrologue || bUseVariants || bUseStringTable || bUseConstants || bUseCompactOps || bUseGroupVarint || bUseIdContexts || bUseMacros)
+	{
+		uint32_t encodeFlags = (bStripEncodeFlags ? kEncodeFlagStripDebugInfo : 0) | (bUseColumnar ? kCrunchEncodeFlagColumnar : 0) |
+			(bUseConstants ? kCrunchEncodeFlagConstants : 0) | (bUseGroupVarint ? kCrunchEncodeFlagGroupVarint : 0) |
+			(bUseIdContexts ? kCrunchEncodeFlagIdContexts : 0);
+
+		vector<const ByteArray*> modules;
+		for (const auto& shader : processedShaders) modules.push_back(shader.payloadSpirv.empty() ? &shader.spirv : &shader.payloadSpirv);
+
+		if (bUseStringTable)
+		{
+			stringTable = buildStringTable(modules, encodeFlags);
+			report.stringTableBytes = stringTable.words.size() * 4;
+
+			if (!bSilent) cout << "Shared string table with " << stringTable.indices.size() << " strings, " << report.stringTableBytes << " bytes" << endl;
+		}
+
+		const int passes = bUseMacros && (bUseDenseOps || bUseRemapTable) ? 2 : 1;
+		size_t macroReferences = 1;
+		for (int pass = 0; pass < passes && macroReferences > 0; ++pass)
+		{
+			DecodeAnalysis tableAnalysis = globalAnalysis;
+			if (bUseMacros)
+			{
+				DecodeAnalysis macroAnalysis;
+				macroAnalysis.SpvOps.push_back({ to_string(kOpMacro), (int)macroReferences });
+				mergeAnalysis(tableAnalysis, macroAnalysis);
+			}
+
+			if (bUseHuffmanOps) remapTable = buildHuffmanOpTable(tableAnalysis);
+			else if (bUseFixedLengths) remapTable = buildFixedLengthOpTable(tableAnalysis, modules, encodeFlags);
+			else if (bUseDenseOps) remapTable = buildDenseOpTable(tableAnalysis);
+			else if (bUseRemapTable) remapTable = buildOpRemapTable(tableAnalysis);
+			else remapTable = getSmolvRemapTable();
+
+			vector<vector<size_t>> instructionOffsets(processedShaders.size());
+			for (size_t i = 0; i < processedShaders.size(); ++i) {
+				auto& shader = processedShaders[i];
+				phaseStart = CrunchClock::now();
+				const ByteArray& spirv = shader.payloadSpirv.empty() ? shader.spirv : shader.payloadSpirv;
+				if (!crunchEncode(spirv, shader.smolv, encodeFlags, remapTable, bUseStringTable ? &stringTable : nullptr, bUseMacros ? &instructionOffsets[i] : nullptr)) {
+					cerr << "Failed to encode with remapped ops: " << shader.name << endl;
+					return 1;
 				}
+				report.shaders[i].encodeUs += elapsedUs(phaseStart);
+				report.addPhase("encode", phaseStart);
+			}
+
+			if (bUseMacros)
+			{
+				phaseStart = CrunchClock::now();
+				macros = buildInstructionMacros(processedShaders, instructionOffsets, remapTable);
+				macroReferences = macros.referenceCount;
+				report.addPhase("macros", phaseStart);
 			}
 		}
-		processedShaders.push_back({ input.arrayName, spirv, smolv, decodedSize });
+
+		if (bUseMacros)
+		{
+			report.macroBytes = macros.bytes.size() + macros.offsets.size() * 4;
+			if (!bSilent) cout << "Macro dictionary with " << macros.entryCount() << " runs, " << report.macroBytes << " bytes, " << macros.referenceCount << " references" << endl;
+		}
+
+		if (!bSilent && bUseDenseOps) cout << "Dense op table with " << remapTable.denseOps.size() << " ops" << endl;
+		if (!bSilent && bUseHuffmanOps) cout << "Huffman op codes of 1-" << remapTable.huffmanLengthCounts.size() << " bits" << endl;
+		if (!bSilent && bUseFixedLengths) cout << "Fixed length ops " << remapTable.fixedLengths.size() << ", " << remapTable.variableNibbles << " op nibbles for the others" << endl;
+		if (!bSilent && bUseRemapTable) cout << "Remapped " << remapTable.swaps.size() << " ops to single nibble codes" << endl;
+	}
+
+	// Similar payloads next to each other, input order estimate is kept for the comparison
+	if (order == "similarity")
+	{
+		if (bEstimate) report.packedInputOrderBytes = estimatePackedSize(processedShaders, sharedPrologue.words, stringTable.words, macros.bytes, macros.offsets, bSkipCruncher, "").payloadBytes;
+
+		phaseStart = CrunchClock::now();
+		orderShadersBySimilarity(processedShaders);
+
+		// Rows follow the payloads, by name as the shaders are named uniquely
+		unordered_map<string, size_t> rowIndices;
+		for (size_t i = 0; i < report.shaders.size(); ++i) rowIndices.emplace(report.shaders[i].name, i);
+
+		vector<CrunchShaderRow> rows;
+		rows.reserve(processedShaders.size());
+		for (const auto& shader : processedShaders) {
+			auto it = rowIndices.find(shader.name);
+			if (it != rowIndices.end()) rows.push_back(std::move(report.shaders[it->second]));
+		}
+		report.shaders = std::move(rows);
+		report.addPhase("order", phaseStart);
 	}
 
 	// Output logic
 	if (bResult)
 	{
-		istringstream templateFile(shadertemplate); // From generated_shadertemplate.h
 		ofstream outFile(filenameOut);
 
-		if (!templateFile || !outFile) {
-			cerr << "Cannot open template or output files" << std::endl;
+		if (!outFile) {
+			cerr << "Cannot open output file" << std::endl;
 			return 1;
 		}
 
-		bResult = generateUberHeader(templateFile, outFile, globalAnalysis, processedShaders, bSkipOptimizer, bSkipCruncher);
+		DecoderSpec decoderSpec;
+		decoderSpec.lookup = buildAnalysisLookup(globalAnalysis);
+		decoderSpec.bSkipOptimizer = bSkipOptimizer;
+		decoderSpec.bUseRemapTable = bUseRemapTable;
+		decoderSpec.remapTable = remapTable;
+		decoderSpec.bPackedOpData = bPackedOpData;
+		decoderSpec.bInstrument = bInstrument;
+		decoderSpec.bColumnar = bUseColumnar;
+		decoderSpec.bSharedPrologue = bUseSharedPrologue;
+		decoderSpec.bVariants = bUseVariants;
+		decoderSpec.bStringTable = bUseStringTable;
+		decoderSpec.bConstantLiterals = bUseConstants;
+		decoderSpec.bCompactOps = bUseCompactOps;
+		decoderSpec.bGroupVarint = bUseGroupVarint;
+		decoderSpec.bIdContexts = bUseIdContexts;
+		decoderSpec.bMacros = macros.entryCount() > 0;
+
+		phaseStart = CrunchClock::now();
+		string decoderText = (bNoDecoder || bSkipCruncher) ? "" : getDecoderText(decoderSpec, cacheDir);
+		report.decoderBytes = decoderText.size();
+		report.addPhase("strip", phaseStart);
+
+		phaseStart = CrunchClock::now();
+		bResult = generateUberHeader(outFile, decoderText, processedShaders, sharedPrologue.words, stringTable.words, macros.bytes, macros.offsets, bSkipCruncher);
 		if (!bResult) {
 			cerr << "Error creating .h file" << std::endl;
 			return 1;
 		}
+		report.headerBytes = (size_t)outFile.tellp();
+		outFile.close();
+		report.addPhase("emit", phaseStart);
+
+		for (size_t i = 0; i < processedShaders.size(); ++i) {
+			size_t skipHeader = bSkipCruncher ? 0 : headerToSkip;
+			report.shaders[i].smolvBytes = processedShaders[i].smolv.size() - skipHeader;
+		}
+
+		if (bEstimate)
+		{
+			phaseStart = CrunchClock::now();
+			PackEstimate estimate = estimatePackedSize(processedShaders, sharedPrologue.words, stringTable.words, macros.bytes, macros.offsets, bSkipCruncher, decoderText);
+			for (size_t i = 0; i < processedShaders.size(); ++i) report.shaders[i].packedBytes = estimate.shaderBytes[i];
+			report.bEstimate = true;
+			report.packedPayloadBytes = estimate.payloadBytes;
+			report.packedDecoderBytes = estimate.decoderBytes;
+			report.packedPrologueBytes = estimate.prologueBytes;
+			report.packedStringTableBytes = estimate.stringTableBytes;
+			report.packedMacroBytes = estimate.macroBytes;
+			report.addPhase("estimate", phaseStart);
+		}
+
+		// Modules after the passes before encoding, for validation and round trip tests
+		if (!spirvOutDir.empty())
+		{
+			error_code ec;
+			fs::create_directories(spirvOutDir, ec);
+			for (const auto& shader : processedShaders) {
+				ofstream spirvOut(fs::path(spirvOutDir) / (shader.name + ".spv"), ios::binary);
+				if (!spirvOut) {
+					cerr << "Cannot write to " << spirvOutDir << std::endl;
+					return 1;
+				}
+				spirvOut.write((const char*)shader.spirv.data(), shader.spirv.size());
+			}
+		}
 
 		if (!bSilent) cout << "Successfully created combined header: " << filenameOut << " with " << processedShaders.size() << " shaders." << std::endl;
+		if (!bSilent && !bSkipCruncher) cout << "Decoder signature: " << getDecoderSignature(decoderSpec) << std::endl;
+
+		if (bEstimate && !bSilent) writeEstimate(cout, report);
+		// Timings still print when the JSON report is on stdout, but to stderr to keep the JSON parseable
+		if (bTimings) writeTimings(bJsonToStdout ? cerr : cout, report);
+
+		if (reportFormat == "json")
+		{
+			if (reportFile.empty()) {
+				writeReportJson(cout, report);
+			}
+			else {
+				ofstream reportOut(reportFile);
+				if (!reportOut) {
+					cerr << "Cannot open report file" << std::endl;
+					return 1;
+				}
+				writeReportJson(reportOut, report);
+			}
+		}
 	}
 
 	return bResult ? 0 : 1;